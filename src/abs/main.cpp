@@ -37,9 +37,7 @@ int main(int argc, char* argv[])
 
         std::string game;
         std::string abstraction;
-        int kmeans_max_iterations;
-        float kmeans_tolerance;
-        int kmeans_runs;
+        holdem_abstraction::kmeans_options kmeans;
         std::string log_file;
 
         po::options_description generic_options("Generic options");
@@ -53,12 +51,20 @@ int main(int argc, char* argv[])
 
         po::options_description holdem_options("holdem options");
         holdem_options.add_options()
-            ("kmeans-max-iterations", po::value<int>(&kmeans_max_iterations)->default_value(100),
+            ("kmeans-max-iterations", po::value<int>(&kmeans.max_iterations)->default_value(100),
                 "maximum amount of iterations")
-            ("kmeans-tolerance", po::value<float>(&kmeans_tolerance)->default_value(1e-4f),
+            ("kmeans-tolerance", po::value<float>(&kmeans.tolerance)->default_value(1e-4f),
                 "relative increment in results to achieve convergence")
-            ("kmeans-runs", po::value<int>(&kmeans_runs)->default_value(1),
+            ("kmeans-runs", po::value<int>(&kmeans.runs)->default_value(1),
                 "number of times to run k-means")
+            ("kmeans-threads-per-run", po::value<int>(&kmeans.threads_per_run)->default_value(0),
+                "run k-means restarts concurrently with this many threads each (0 = one restart at a time)")
+            ("river-mini-batch-size", po::value<int>(&kmeans.river_batch_size)->default_value(0),
+                "cluster the river with mini-batch k-means using batches of this size (0 = full k-means)")
+            ("river-mini-batch-iterations", po::value<int>(&kmeans.river_batch_iterations)->default_value(1000),
+                "number of mini-batches to process on the river")
+            ("river-compare-full", po::bool_switch(&kmeans.river_compare),
+                "also run full k-means on the river and report the cost difference to mini-batch k-means")
             ;
 
         po::options_description desc("Options");
@@ -96,7 +102,7 @@ int main(int argc, char* argv[])
         if (game == "holdem")
         {
             holdem_abstraction abs;
-            abs.write(abstraction + ".abs", kmeans_max_iterations, kmeans_tolerance, kmeans_runs);
+            abs.write(abstraction + ".abs", kmeans);
         }
         else
         {
@@ -4,213 +4,442 @@
 #endif
 #include <omp.h>
 #include <numeric>
+#include <algorithm>
+#include <limits>
+#include <cstring>
 #include <boost/regex.hpp>
 #include <boost/assign/list_of.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 #include "util/k_means.h"
+#include "util/compact_histogram.h"
 #include "util/binary_io.h"
 #include "lutlib/hand_indexer.h"
 #include "util/metric.h"
 #include "lutlib/holdem_river_lut.h"
 #include "lutlib/holdem_river_ochs_lut.h"
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static_assert(sizeof(holdem_abstraction::header_type) == 104, "abstraction header layout changed");
+
+const std::uint64_t holdem_abstraction::HEADER_MAGIC;
+const std::uint32_t holdem_abstraction::HEADER_VERSION;
+const std::uint64_t holdem_abstraction::FILE_ALIGNMENT;
+
 namespace
 {
     typedef holdem_abstraction::bucket_idx_t bucket_idx_t;
 
-    template<int Dimensions>
-    std::vector<bucket_idx_t> create_preflop_buckets(const hand_indexer& indexer, const holdem_river_lut& river_lut,
-        int cluster_count, int kmeans_max_iterations, float tolerance, int runs)
+    static const int HISTOGRAM_BINS = 50;
+
+    // river outcomes are reached through both orders of the turn and river cards when flop histograms are summed
+    // from turn histograms, and through every 3 + 2 split of the board when preflop histograms are summed from
+    // flop histograms
+    static const int FLOP_MULTIPLICITY = 2;
+    static const int PREFLOP_MULTIPLICITY = 10 * FLOP_MULTIPLICITY;
+
+    static const char* RIVER_LUT_FILENAME = "holdem_river_lut.dat";
+
+    // histogram cache files start with this header; the histograms of every round are derived from the river LUT
+    // so they all record its size and modification time and are rebuilt once it changes
+    struct histogram_header
     {
-        typedef std::array<float, Dimensions> point_t;
-        std::vector<point_t> data_points(indexer.get_size(indexer.get_rounds() - 1));
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t bins;
+        std::uint64_t count;
+        std::uint64_t river_size;
+        std::int64_t river_time;
+    };
+
+    static const std::uint64_t HISTOGRAM_MAGIC = 0x545348534144494dull; // "MIDASHST"
+    static const std::uint32_t HISTOGRAM_VERSION = 1;
+
+    // hand strength histograms over all river completions, memory mapped from cache files; counts are at most 46
+    // on the turn, 2 * 1081 on the flop and 20 * 2118760 preflop
+    template<class T>
+    struct histogram_file
+    {
+        typedef std::array<T, HISTOGRAM_BINS> histogram_t;
 
-#pragma omp parallel for
-        for (std::int64_t i = 0; i < static_cast<std::int64_t>(data_points.size()); ++i)
+        const histogram_t* data() const
         {
-            auto& p = data_points[i];
-            std::fill(p.begin(), p.end(), typename point_t::value_type());
+            return reinterpret_cast<const histogram_t*>(file.data() + sizeof(histogram_header));
+        }
 
-            std::array<uint8_t, 2> cards;
-            indexer.hand_unindex(indexer.get_rounds() - 1, i, cards.data());
+        std::size_t size() const
+        {
+            return (file.size() - sizeof(histogram_header)) / sizeof(histogram_t);
+        }
 
-            const auto c0 = cards[0];
-            const auto c1 = cards[1];
+        boost::iostreams::mapped_file_source file;
+    };
 
-            for (int b0 = 0; b0 < 48; ++b0)
-            {
-                if (b0 == c0 || b0 == c1)
-                    continue;
+    struct histogram_set
+    {
+        histogram_file<std::uint32_t> preflop;
+        histogram_file<std::uint16_t> flop;
+        histogram_file<std::uint8_t> turn;
+    };
 
-                for (int b1 = b0 + 1; b1 < 49; ++b1)
-                {
-                    if (b1 == c0 || b1 == c1)
-                        continue;
+    std::string get_histogram_filename(const holdem_state::game_round round)
+    {
+        static const char* names[] = {"preflop", "flop", "turn"};
+        return std::string("holdem_") + names[round] + "_hist_" + std::to_string(HISTOGRAM_BINS) + ".dat";
+    }
 
-                    for (int b2 = b1 + 1; b2 < 50; ++b2)
-                    {
-                        if (b2 == c0 || b2 == c1)
-                            continue;
+    histogram_header get_histogram_header(const std::size_t count)
+    {
+        if (!boost::filesystem::exists(RIVER_LUT_FILENAME))
+            throw std::runtime_error(std::string("Unable to find ") + RIVER_LUT_FILENAME);
+
+        histogram_header header;
+        header.magic = HISTOGRAM_MAGIC;
+        header.version = HISTOGRAM_VERSION;
+        header.bins = HISTOGRAM_BINS;
+        header.count = count;
+        header.river_size = boost::filesystem::file_size(RIVER_LUT_FILENAME);
+        header.river_time = boost::filesystem::last_write_time(RIVER_LUT_FILENAME);
+        return header;
+    }
 
-                        for (int b3 = b2 + 1; b3 < 51; ++b3)
-                        {
-                            if (b3 == c0 || b3 == c1)
-                                continue;
-
-                            for (int b4 = b3 + 1; b4 < 52; ++b4)
-                            {
-                                if (b4 == c0 || b4 == c1)
-                                    continue;
-
-                                const std::array<int, 7> int_cards = {{c0, c1, b0, b1, b2, b3, b4}};
-                                const auto hs = river_lut.get(int_cards);
-                                const auto bin = std::min(std::size_t(hs * p.size()), p.size() - 1);
-                                ++data_points[i][bin];
-                            }
-                        }
-                    }
-                }
-            }
+    bool is_histogram_cache_valid(const std::string& filename, const histogram_header& expected,
+        const std::size_t histogram_size)
+    {
+        if (!boost::filesystem::exists(filename)
+            || boost::filesystem::file_size(filename) != sizeof(histogram_header) + expected.count * histogram_size)
+        {
+            return false;
+        }
+
+        auto file = binary_open(filename, "rb");
+
+        if (!file)
+            return false;
+
+        histogram_header header;
+        binary_read(*file, header);
 
-            const auto sum = std::accumulate(p.begin(), p.end(), typename point_t::value_type());
+        return header.magic == expected.magic && header.version == expected.version && header.bins == expected.bins
+            && header.count == expected.count && header.river_size == expected.river_size
+            && header.river_time == expected.river_time;
+    }
+
+    // histograms only depend on the river LUT so they are cached on disk and reused by every abstraction until the
+    // river LUT changes; the cache file is written under a temporary name first so an interrupted run never leaves
+    // a truncated cache
+    template<class T, class Create>
+    void open_histograms(const holdem_state::game_round round, const std::size_t size, Create create,
+        histogram_file<T>* histograms)
+    {
+        typedef typename histogram_file<T>::histogram_t histogram_t;
 
-            for (auto it = p.begin(); it != p.end(); ++it)
-                *it /= sum;
+        const auto filename = get_histogram_filename(round);
+        const auto header = get_histogram_header(size);
+
+        if (!is_histogram_cache_valid(filename, header, sizeof(histogram_t)))
+        {
+            BOOST_LOG_TRIVIAL(info) << "Creating " << filename;
+
+            std::vector<histogram_t> data(size);
+            create(&data);
+
+            const auto temp_filename = filename + ".tmp";
+
+            {
+                auto file = binary_open(temp_filename, "wb");
+
+                if (!file)
+                    throw std::runtime_error("Unable to open histogram cache file");
+
+                binary_write(*file, header);
+                binary_write(*file, data.data(), data.size());
+            }
+
+            boost::filesystem::rename(temp_filename, filename);
         }
 
-        std::vector<bucket_idx_t> buckets;
-        std::vector<point_t> centers;
+        histograms->file.open(filename);
 
-        k_means<point_t, bucket_idx_t, get_emd_distance, get_emd_cost>().run(data_points, cluster_count,
-            kmeans_max_iterations, tolerance, OPTIMAL, runs, &buckets, &centers);
+        if (!histograms->file)
+            throw std::runtime_error("Unable to open histogram cache file");
+    }
 
-        return buckets;
+    std::size_t get_bin(const float hs)
+    {
+        return std::min(std::size_t(hs * HISTOGRAM_BINS), std::size_t(HISTOGRAM_BINS - 1));
+    }
+
+    void create_turn_histograms(const hand_indexer& indexer, const holdem_river_lut& river_lut,
+        std::vector<std::array<std::uint8_t, HISTOGRAM_BINS>>* turn)
+    {
+        turn->resize(indexer.get_size(indexer.get_rounds() - 1));
+
+        const auto& river_indexer = river_lut.get_indexer();
+
+        indexer.for_each_hand(indexer.get_rounds() - 1, [&](const hand_indexer::hand_index_t index,
+            const card_t* cards)
+        {
+            auto& p = (*turn)[index];
+            std::fill(p.begin(), p.end(), std::uint8_t());
+
+            river_indexer.index_completions<7>(cards, [&](const hand_indexer::hand_index_t indices[],
+                const std::size_t count)
+            {
+                for (std::size_t j = 0; j < count; ++j)
+                    ++p[get_bin(river_lut.get(indices[j]))];
+            });
+        });
     }
 
-    template<int Dimensions>
-    std::vector<bucket_idx_t> create_flop_buckets(const hand_indexer& indexer, const holdem_river_lut& river_lut,
-        int cluster_count, int kmeans_max_iterations, float tolerance, int runs)
+    void create_flop_histograms(const hand_indexer& indexer, const hand_indexer& turn_indexer,
+        const histogram_file<std::uint8_t>& turn,
+        std::vector<std::array<std::uint16_t, HISTOGRAM_BINS>>* flop)
     {
-        typedef std::array<float, Dimensions> point_t;
-        std::vector<point_t> data_points(indexer.get_size(indexer.get_rounds() - 1));
+        flop->resize(indexer.get_size(indexer.get_rounds() - 1));
+
+        indexer.for_each_hand(indexer.get_rounds() - 1, [&](const hand_indexer::hand_index_t index,
+            const card_t* cards)
+        {
+            auto& p = (*flop)[index];
+            std::fill(p.begin(), p.end(), std::uint16_t());
+
+            turn_indexer.index_completions<6>(cards, [&](const hand_indexer::hand_index_t indices[],
+                const std::size_t count)
+            {
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    const auto& t = turn.data()[indices[i]];
+
+                    for (std::size_t j = 0; j < p.size(); ++j)
+                        p[j] = static_cast<std::uint16_t>(p[j] + t[j]);
+                }
+            });
+        });
+    }
+
+    void create_preflop_histograms(const hand_indexer& indexer, const hand_indexer& flop_indexer,
+        const histogram_file<std::uint16_t>& flop,
+        std::vector<std::array<std::uint32_t, HISTOGRAM_BINS>>* preflop)
+    {
+        preflop->resize(indexer.get_size(indexer.get_rounds() - 1));
 
 #pragma omp parallel for
-        for (std::int64_t i = 0; i < static_cast<std::int64_t>(data_points.size()); ++i)
+        for (std::int64_t i = 0; i < static_cast<std::int64_t>(preflop->size()); ++i)
         {
-            auto& p = data_points[i];
-            std::fill(p.begin(), p.end(), typename point_t::value_type());
+            auto& p = (*preflop)[i];
+            std::fill(p.begin(), p.end(), std::uint32_t());
 
-            std::array<uint8_t, 5> cards;
+            std::array<card_t, 5> cards;
             indexer.hand_unindex(indexer.get_rounds() - 1, i, cards.data());
 
             const auto c0 = cards[0];
             const auto c1 = cards[1];
-            const auto b0 = cards[2];
-            const auto b1 = cards[3];
-            const auto b2 = cards[4];
 
-            for (int b3 = 0; b3 < 51; ++b3)
+            for (int b0 = 0; b0 < 50; ++b0)
             {
-                if (b3 == c0 || b3 == c1 || b3 == b0 || b3 == b1 || b3 == b2)
+                if (b0 == c0 || b0 == c1)
                     continue;
 
-                for (int b4 = b3 + 1; b4 < 52; ++b4)
+                for (int b1 = b0 + 1; b1 < 51; ++b1)
                 {
-                    if (b4 == c0 || b4 == c1 || b4 == b0 || b4 == b1 || b4 == b2)
+                    if (b1 == c0 || b1 == c1)
                         continue;
 
-                    const std::array<int, 7> int_cards = {{c0, c1, b0, b1, b2, b3, b4}};
-                    const auto hs = river_lut.get(int_cards);
-                    const auto bin = std::min(std::size_t(hs * p.size()), p.size() - 1);
-                    ++data_points[i][bin];
+                    for (int b2 = b1 + 1; b2 < 52; ++b2)
+                    {
+                        if (b2 == c0 || b2 == c1)
+                            continue;
+
+                        cards[2] = static_cast<card_t>(b0);
+                        cards[3] = static_cast<card_t>(b1);
+                        cards[4] = static_cast<card_t>(b2);
+                        const auto& f = flop.data()[flop_indexer.hand_index_last(cards.data())];
+
+                        for (std::size_t j = 0; j < p.size(); ++j)
+                            p[j] += f[j];
+                    }
                 }
             }
+        }
+    }
+
+    // converts histograms back to river completion counts; the points keep the integer counts to reduce k-means
+    // memory and bandwidth while the cluster centers are regular float arrays
+    template<class T>
+    std::vector<compact_histogram<T, HISTOGRAM_BINS>> get_data_points(const histogram_file<T>& histograms,
+        const T multiplicity)
+    {
+        std::vector<compact_histogram<T, HISTOGRAM_BINS>> data_points(histograms.size());
+
+#pragma omp parallel for
+        for (std::int64_t i = 0; i < static_cast<std::int64_t>(data_points.size()); ++i)
+        {
+            auto counts = histograms.data()[i];
 
-            const auto sum = std::accumulate(p.begin(), p.end(), typename point_t::value_type());
+            for (auto& count : counts)
+            {
+                assert(count % multiplicity == 0);
+                count /= multiplicity;
+            }
 
-            for (auto it = p.begin(); it != p.end(); ++it)
-                *it /= sum;
+            data_points[i] = compact_histogram<T, HISTOGRAM_BINS>(counts);
         }
 
+        return data_points;
+    }
+
+    template<class T>
+    std::vector<bucket_idx_t> create_histogram_buckets(const histogram_file<T>& histograms, T multiplicity,
+        int cluster_count, const holdem_abstraction::kmeans_options& options)
+    {
+        typedef compact_histogram<T, HISTOGRAM_BINS> point_t;
+        typedef std::array<float, HISTOGRAM_BINS> center_t;
+
         std::vector<bucket_idx_t> buckets;
-        std::vector<point_t> centers;
+        std::vector<center_t> centers;
+
+        k_means<point_t, bucket_idx_t, get_emd_distance, get_emd_cost, center_t> clustering(YINYANG);
+        clustering.set_threads_per_run(options.threads_per_run);
 
-        k_means<point_t, bucket_idx_t, get_emd_distance, get_emd_cost>().run(data_points, cluster_count,
-            kmeans_max_iterations, tolerance, OPTIMAL, runs, &buckets, &centers);
+        // many hands share a histogram (e.g. on paired or monotone boards) so identical points are clustered once
+        clustering.run_unique(get_data_points(histograms, multiplicity), cluster_count, options.max_iterations,
+            options.tolerance, OPTIMAL, options.runs, &buckets, &centers);
 
         return buckets;
     }
 
-    template<int Dimensions>
-    std::vector<bucket_idx_t> create_turn_buckets(const hand_indexer& indexer, const holdem_river_lut& river_lut,
-        int cluster_count, int kmeans_max_iterations, float tolerance, int runs)
+    static const char* RIVER_OCHS_LUT_FILENAME = "holdem_river_ochs_lut.dat";
+
+    std::vector<bucket_idx_t> create_river_buckets(const hand_indexer& indexer, int cluster_count,
+        const holdem_abstraction::kmeans_options& options)
     {
-        typedef std::array<float, Dimensions> point_t;
-        std::vector<point_t> data_points(indexer.get_size(indexer.get_rounds() - 1));
+        typedef holdem_river_ochs_lut::data_type point_t;
+        typedef k_means<point_t, bucket_idx_t, get_l2_distance, get_l2_cost> k_means_t;
+
+        std::vector<bucket_idx_t> buckets;
+        std::vector<point_t> centers;
+        k_means_t clustering;
+        clustering.set_threads_per_run(options.threads_per_run);
+
+        const auto point_count = indexer.get_size(indexer.get_rounds() - 1);
+
+        // full k-means works on a private copy of the points, decoded from quantized tables, while mini-batch
+        // k-means only needs the unique points and reads them from the shared mapping
+        const auto read_points = [point_count](const holdem_river_ochs_lut& river_lut)
+        {
+            if (river_lut.get_data())
+                return std::vector<point_t>(river_lut.get_data(), river_lut.get_data() + point_count);
+
+            std::vector<point_t> points(point_count);
 
 #pragma omp parallel for
-        for (std::int64_t i = 0; i < static_cast<std::int64_t>(data_points.size()); ++i)
+            for (std::int64_t i = 0; i < static_cast<std::int64_t>(point_count); ++i)
+                points[i] = river_lut.get_data(static_cast<holdem_river_ochs_lut::index_t>(i));
+
+            return points;
+        };
+
+        const auto get_points = [&read_points]()
         {
-            auto& p = data_points[i];
-            std::fill(p.begin(), p.end(), typename point_t::value_type());
+            return read_points(holdem_river_ochs_lut(RIVER_OCHS_LUT_FILENAME, true));
+        };
 
-            std::array<uint8_t, 6> cards;
-            indexer.hand_unindex(indexer.get_rounds() - 1, i, cards.data());
+        // paired and monotone boards give many hands the same OCHS vector so identical points are clustered once
+        if (options.river_batch_size <= 0)
+        {
+            clustering.run_unique(get_points(), cluster_count, options.max_iterations, options.tolerance, OPTIMAL,
+                options.runs, &buckets, &centers);
 
-            const auto c0 = cards[0];
-            const auto c1 = cards[1];
-            const auto b0 = cards[2];
-            const auto b1 = cards[3];
-            const auto b2 = cards[4];
-            const auto b3 = cards[5];
+            return buckets;
+        }
+
+        auto min_cost = std::numeric_limits<k_means_t::distance_t>::max();
+
+        {
+            const holdem_river_ochs_lut river_lut(RIVER_OCHS_LUT_FILENAME);
 
-            for (int b4 = 0; b4 < 52; ++b4)
+            // batches are drawn from the unique points in proportion to their multiplicity; entries of quantized
+            // tables are decoded as they are deduplicated instead of into a copy of the whole table
+            std::vector<point_t> unique_points;
+            k_means_t::weight_vector_t weights;
+            std::vector<std::size_t> unique_indices;
+
+            if (const auto points = river_lut.get_data())
             {
-                if (b4 == c0 || b4 == c1 || b4 == b0 || b4 == b1 || b4 == b2 || b4 == b3)
-                    continue;
+                k_means_t::make_unique_points(points, point_count, &unique_points, &weights, &unique_indices);
+            }
+            else
+            {
+                k_means_t::make_unique_points_with([&river_lut](const std::size_t i)
+                {
+                    return river_lut.get_data(static_cast<holdem_river_ochs_lut::index_t>(i));
+                }, point_count, &unique_points, &weights, &unique_indices);
+            }
+
+            BOOST_LOG_TRIVIAL(info) << "River points: " << unique_points.size() << " unique of " << point_count;
 
-                const std::array<int, 7> int_cards = {{c0, c1, b0, b1, b2, b3, b4}};
-                const auto hs = river_lut.get(int_cards);
-                const auto bin = std::min(std::size_t(hs * p.size()), p.size() - 1);
-                ++data_points[i][bin];
+            std::vector<bucket_idx_t> unique_buckets;
+
+            if (static_cast<bucket_idx_t>(unique_points.size()) <= cluster_count)
+            {
+                // every unique point gets its own cluster
+                unique_buckets.resize(unique_points.size());
+                std::iota(unique_buckets.begin(), unique_buckets.end(), bucket_idx_t());
+                min_cost = 0;
             }
+            else
+            {
+                std::vector<bucket_idx_t> run_buckets;
+                std::vector<point_t> run_centers;
 
-            const auto sum = std::accumulate(p.begin(), p.end(), typename point_t::value_type());
+                for (int i = 0; i < options.runs; ++i)
+                {
+                    const auto cost = clustering.run_mini_batch(unique_points.data(), unique_points.size(), weights,
+                        cluster_count, options.river_batch_size, options.river_batch_iterations, OPTIMAL, true,
+                        &run_buckets, &run_centers);
 
-            for (auto it = p.begin(); it != p.end(); ++it)
-                *it /= sum;
-        }
+                    if (cost < min_cost)
+                    {
+                        unique_buckets.swap(run_buckets);
+                        centers.swap(run_centers);
+                        min_cost = cost;
+                    }
+                }
+            }
 
-        std::vector<bucket_idx_t> buckets;
-        std::vector<point_t> centers;
+            buckets.resize(point_count);
 
-        k_means<point_t, bucket_idx_t, get_emd_distance, get_emd_cost>().run(data_points, cluster_count,
-            kmeans_max_iterations, tolerance, OPTIMAL, runs, &buckets, &centers);
+#pragma omp parallel for
+            for (std::int64_t i = 0; i < static_cast<std::int64_t>(point_count); ++i)
+                buckets[i] = unique_buckets[unique_indices[i]];
+        }
 
-        return buckets;
-    }
+        BOOST_LOG_TRIVIAL(info) << "River mini-batch k-means cost: " << min_cost;
 
-    template<int Dimensions>
-    std::vector<bucket_idx_t> create_river_buckets(const holdem_river_ochs_lut& river_lut, int cluster_count,
-        int kmeans_max_iterations, float tolerance, int runs)
-    {
-        typedef std::array<float, Dimensions> point_t;
+        if (options.river_compare)
+        {
+            std::vector<bucket_idx_t> full_buckets;
+            std::vector<point_t> full_centers;
 
-        std::vector<bucket_idx_t> buckets;
-        std::vector<point_t> centers;
+            const auto full_cost = clustering.run_unique(get_points(), cluster_count, options.max_iterations,
+                options.tolerance, OPTIMAL, options.runs, &full_buckets, &full_centers);
 
-        k_means<point_t, bucket_idx_t, get_l2_distance, get_l2_cost>().run(river_lut.get_data(), cluster_count,
-            kmeans_max_iterations, tolerance, OPTIMAL, runs, &buckets, &centers);
+            BOOST_LOG_TRIVIAL(info) << "River full k-means cost: " << full_cost << " (mini-batch "
+                << std::showpos << (min_cost / full_cost - 1) * 100 << std::noshowpos << "%)";
+        }
 
         return buckets;
     }
 
     std::vector<bucket_idx_t> create_buckets(const holdem_state::game_round round, const hand_indexer& indexer,
-        const holdem_river_lut& river_lut, const holdem_river_ochs_lut& river_ochs_lut, int cluster_count,
-        int kmeans_max_iterations, float tolerance, int runs)
+        const histogram_set& histograms, int cluster_count, const holdem_abstraction::kmeans_options& options)
     {
         const auto index_count = static_cast<bucket_idx_t>(indexer.get_size(indexer.get_rounds() - 1));
 
@@ -227,17 +456,15 @@ namespace
             switch (round)
             {
             case holdem_state::PREFLOP:
-                return create_preflop_buckets<50>(indexer, river_lut, cluster_count, kmeans_max_iterations, tolerance,
-                    runs);
+                return create_histogram_buckets(histograms.preflop, std::uint32_t(PREFLOP_MULTIPLICITY), cluster_count,
+                    options);
             case holdem_state::FLOP:
-                return create_flop_buckets<50>(indexer, river_lut, cluster_count, kmeans_max_iterations, tolerance,
-                    runs);
+                return create_histogram_buckets(histograms.flop, std::uint16_t(FLOP_MULTIPLICITY), cluster_count,
+                    options);
             case holdem_state::TURN:
-                return create_turn_buckets<50>(indexer, river_lut, cluster_count, kmeans_max_iterations, tolerance,
-                    runs);
+                return create_histogram_buckets(histograms.turn, std::uint8_t(1), cluster_count, options);
             case holdem_state::RIVER:
-                return create_river_buckets<8>(river_ochs_lut, cluster_count, kmeans_max_iterations, tolerance,
-                    runs);
+                return create_river_buckets(indexer, cluster_count, options);
             default:
                 throw std::runtime_error("invalid round");
             }
@@ -280,6 +507,8 @@ holdem_abstraction::holdem_abstraction()
     : imperfect_recall_(false)
     , bucket_counts_()
     , file_()
+    , bucket_size_(sizeof(bucket_idx_t))
+    , rounds_()
 {
 }
 
@@ -302,10 +531,22 @@ void holdem_abstraction::get_buckets(const int c0, const int c1, const int b0, c
         static_cast<card_t>(b3),
         static_cast<card_t>(b4)}};
 
-    (*buckets)[holdem_state::PREFLOP] = read(holdem_state::PREFLOP, preflop_indexer_.hand_index_last(cards.data()));
-    (*buckets)[holdem_state::FLOP] = (b0 != -1) ? read(holdem_state::FLOP, flop_indexer_.hand_index_last(cards.data())) : -1;
-    (*buckets)[holdem_state::TURN] = (b3 != -1) ? read(holdem_state::TURN, turn_indexer_.hand_index_last(cards.data())) : -1;
-    (*buckets)[holdem_state::RIVER] = (b4 != -1) ? read(holdem_state::RIVER, river_indexer_.hand_index_last(cards.data())) : -1;
+    // every indexer starts with the hole cards so they are canonicalized once and the resulting state is shared by
+    // the board rounds of the postflop indexers
+    hand_indexer_state_t preflop_state;
+    preflop_indexer_.hand_index_init(&preflop_state);
+    (*buckets)[holdem_state::PREFLOP] = read(holdem_state::PREFLOP,
+        preflop_indexer_.hand_index_next_round(cards.data(), &preflop_state));
+
+    const auto index_board = [&cards, &preflop_state](const hand_indexer& indexer)
+    {
+        auto state = preflop_state;
+        return indexer.hand_index_next_round(cards.data() + 2, &state);
+    };
+
+    (*buckets)[holdem_state::FLOP] = (b0 != -1) ? read(holdem_state::FLOP, index_board(flop_indexer_)) : -1;
+    (*buckets)[holdem_state::TURN] = (b3 != -1) ? read(holdem_state::TURN, index_board(turn_indexer_)) : -1;
+    (*buckets)[holdem_state::RIVER] = (b4 != -1) ? read(holdem_state::RIVER, index_board(river_indexer_)) : -1;
 }
 
 void holdem_abstraction::read(const std::string& filename)
@@ -316,35 +557,183 @@ void holdem_abstraction::read(const std::string& filename)
 
     if (!file_)
         throw std::runtime_error("Unable to open file");
+
+    const auto data = file_.data();
+    const auto size = file_.size();
+    std::array<std::uint64_t, holdem_state::ROUNDS> offsets;
+    std::array<std::uint64_t, holdem_state::ROUNDS> sizes;
+
+    if (size >= sizeof(header_type) && reinterpret_cast<const header_type*>(data)->magic == HEADER_MAGIC)
+    {
+        const auto header = reinterpret_cast<const header_type*>(data);
+
+        if (header->version != HEADER_VERSION)
+            throw std::runtime_error("Unsupported abstraction file version");
+
+        if (header->bucket_size != sizeof(std::uint16_t) && header->bucket_size != sizeof(bucket_idx_t))
+            throw std::runtime_error("Invalid abstraction bucket size");
+
+        if ((header->imperfect_recall != 0) != imperfect_recall_
+            || !std::equal(bucket_counts_.begin(), bucket_counts_.end(), header->bucket_counts.begin()))
+        {
+            throw std::runtime_error("Abstraction file does not match its configuration");
+        }
+
+        bucket_size_ = header->bucket_size;
+        offsets = header->offsets;
+        sizes = header->sizes;
+    }
+    else
+    {
+        // legacy files are [imperfect_recall] followed by [size][int buckets...] for each round
+        bucket_size_ = sizeof(bucket_idx_t);
+        std::uint64_t pos = sizeof(bool);
+
+        for (int i = 0; i < holdem_state::ROUNDS; ++i)
+        {
+            if (pos + sizeof(std::uint64_t) > size)
+                throw std::runtime_error("Invalid abstraction file size");
+
+            std::memcpy(&sizes[i], data + pos, sizeof(std::uint64_t));
+            offsets[i] = pos + sizeof(std::uint64_t);
+            pos = offsets[i] + sizes[i] * bucket_size_;
+        }
+    }
+
+    for (int i = 0; i < holdem_state::ROUNDS; ++i)
+    {
+        const auto& indexer = get_indexer(holdem_state::game_round(i));
+
+        if (sizes[i] != indexer.get_size(indexer.get_rounds() - 1) || offsets[i] + sizes[i] * bucket_size_ > size)
+            throw std::runtime_error("Invalid abstraction file size");
+
+        rounds_[i] = data + offsets[i];
+    }
+
+#ifdef __linux__
+    // lookups are random so transparent huge pages save most of the TLB misses where the kernel supports them
+    // for file mappings; the advice is best effort
+    madvise(const_cast<char*>(data), size, MADV_HUGEPAGE);
+#endif
 }
 
-void holdem_abstraction::write(const std::string& filename, const int kmeans_max_iterations, float tolerance,
-    int runs)
+holdem_abstraction::kmeans_options::kmeans_options()
+    : max_iterations(100)
+    , tolerance(1e-4f)
+    , runs(1)
+    , threads_per_run(0)
+    , river_batch_size(0)
+    , river_batch_iterations(1000)
+    , river_compare(false)
+{
+}
+
+void holdem_abstraction::write(const std::string& filename, const kmeans_options& options)
 {
     parse_configuration(filename, &imperfect_recall_, &bucket_counts_);
 
-    std::unique_ptr<holdem_river_lut> river_lut(new holdem_river_lut("holdem_river_lut.dat"));
-    std::shared_ptr<holdem_river_ochs_lut> river_ochs_lut(new holdem_river_ochs_lut("holdem_river_ochs_lut.dat"));
+    // the river LUT is only walked once for the turn histograms, the earlier rounds are summed from the next one
+    histogram_set histograms;
+
+    open_histograms(holdem_state::TURN, turn_indexer_.get_size(turn_indexer_.get_rounds() - 1),
+        [](std::vector<std::array<std::uint8_t, HISTOGRAM_BINS>>* turn)
+        {
+            // every river hand is looked up so the whole LUT is read ahead
+            std::unique_ptr<holdem_river_lut> river_lut(new holdem_river_lut(RIVER_LUT_FILENAME, true));
+            create_turn_histograms(turn_indexer_, *river_lut, turn);
+        }, &histograms.turn);
+
+    open_histograms(holdem_state::FLOP, flop_indexer_.get_size(flop_indexer_.get_rounds() - 1),
+        [&histograms](std::vector<std::array<std::uint16_t, HISTOGRAM_BINS>>* flop)
+        {
+            create_flop_histograms(flop_indexer_, turn_indexer_, histograms.turn, flop);
+        }, &histograms.flop);
+
+    open_histograms(holdem_state::PREFLOP, preflop_indexer_.get_size(preflop_indexer_.get_rounds() - 1),
+        [&histograms](std::vector<std::array<std::uint32_t, HISTOGRAM_BINS>>* preflop)
+        {
+            create_preflop_histograms(preflop_indexer_, flop_indexer_, histograms.flop, preflop);
+        }, &histograms.preflop);
+
+    const auto preflop_buckets = create_buckets(holdem_state::PREFLOP, preflop_indexer_, histograms,
+        bucket_counts_[holdem_state::PREFLOP], options);
+    const auto flop_buckets = create_buckets(holdem_state::FLOP, flop_indexer_, histograms,
+        bucket_counts_[holdem_state::FLOP], options);
+    const auto turn_buckets = create_buckets(holdem_state::TURN, turn_indexer_, histograms,
+        bucket_counts_[holdem_state::TURN], options);
+    const auto river_buckets = create_buckets(holdem_state::RIVER, river_indexer_, histograms,
+        bucket_counts_[holdem_state::RIVER], options);
+
+    const std::array<const std::vector<bucket_idx_t>*, holdem_state::ROUNDS> buckets = {{
+        &preflop_buckets, &flop_buckets, &turn_buckets, &river_buckets}};
+
+    write_buckets(filename, imperfect_recall_, bucket_counts_, buckets);
+}
+
+void holdem_abstraction::write_buckets(const std::string& filename, const bool imperfect_recall,
+    const bucket_counts_t& bucket_counts,
+    const std::array<const std::vector<bucket_idx_t>*, holdem_state::ROUNDS>& buckets)
+{
+    for (int i = 0; i < holdem_state::ROUNDS; ++i)
+    {
+        const auto& indexer = get_indexer(holdem_state::game_round(i));
+
+        if (buckets[i]->size() != indexer.get_size(indexer.get_rounds() - 1))
+            throw std::runtime_error("Invalid abstraction round size");
+    }
+
+    header_type header;
+    std::memset(&header, 0, sizeof(header));
+
+    header.magic = HEADER_MAGIC;
+    header.version = HEADER_VERSION;
+    header.bucket_size = *std::max_element(bucket_counts.begin(), bucket_counts.end())
+        <= std::numeric_limits<std::uint16_t>::max() + 1 ? sizeof(std::uint16_t) : sizeof(bucket_idx_t);
+    header.imperfect_recall = imperfect_recall;
+    std::copy(bucket_counts.begin(), bucket_counts.end(), header.bucket_counts.begin());
 
-    const auto preflop_buckets = create_buckets(holdem_state::PREFLOP, preflop_indexer_, *river_lut, *river_ochs_lut,
-        bucket_counts_[holdem_state::PREFLOP], kmeans_max_iterations, tolerance, runs);
-    const auto flop_buckets = create_buckets(holdem_state::FLOP, flop_indexer_, *river_lut, *river_ochs_lut,
-        bucket_counts_[holdem_state::FLOP], kmeans_max_iterations, tolerance, runs);
-    const auto turn_buckets = create_buckets(holdem_state::TURN, turn_indexer_, *river_lut, *river_ochs_lut,
-        bucket_counts_[holdem_state::TURN], kmeans_max_iterations, tolerance, runs);
-    const auto river_buckets = create_buckets(holdem_state::RIVER, river_indexer_, *river_lut, *river_ochs_lut,
-        bucket_counts_[holdem_state::RIVER], kmeans_max_iterations, tolerance, runs);
+    std::uint64_t pos = sizeof(header);
+
+    for (int i = 0; i < holdem_state::ROUNDS; ++i)
+    {
+        header.offsets[i] = (pos + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+        header.sizes[i] = buckets[i]->size();
+        pos = header.offsets[i] + header.sizes[i] * header.bucket_size;
+    }
 
     auto file = binary_open(filename.c_str(), "wb");
 
     if (!file)
         throw std::runtime_error("Unable to open file");
 
-    binary_write(*file, imperfect_recall_);
-    binary_write(*file, preflop_buckets);
-    binary_write(*file, flop_buckets);
-    binary_write(*file, turn_buckets);
-    binary_write(*file, river_buckets);
+    binary_write(*file, header);
+    pos = sizeof(header);
+
+    for (int i = 0; i < holdem_state::ROUNDS; ++i)
+    {
+        const std::vector<char> padding(header.offsets[i] - pos);
+        binary_write(*file, padding.data(), padding.size());
+
+        if (header.bucket_size == sizeof(std::uint16_t))
+        {
+            // narrowed in chunks to avoid a second copy of the river buckets
+            const std::size_t chunk_size = 1 << 20;
+            std::vector<std::uint16_t> chunk;
+
+            for (std::size_t j = 0; j < buckets[i]->size(); j += chunk_size)
+            {
+                const auto begin = buckets[i]->begin() + j;
+                chunk.assign(begin, begin + std::min(chunk_size, buckets[i]->size() - j));
+                binary_write(*file, chunk.data(), chunk.size());
+            }
+        }
+        else
+        {
+            binary_write(*file, buckets[i]->data(), buckets[i]->size());
+        }
+
+        pos = header.offsets[i] + header.sizes[i] * header.bucket_size;
+    }
 }
 
 holdem_abstraction::bucket_idx_t holdem_abstraction::read(holdem_state::game_round round,
@@ -356,25 +745,27 @@ holdem_abstraction::bucket_idx_t holdem_abstraction::read(holdem_state::game_rou
         return 0;
     }
 
-    std::size_t pos = sizeof(imperfect_recall_);
+    const auto p = rounds_[round];
+
+    if (bucket_size_ == sizeof(std::uint16_t))
+        return reinterpret_cast<const std::uint16_t*>(p)[index];
+    else
+        return reinterpret_cast<const bucket_idx_t*>(p)[index];
+}
 
+const hand_indexer& holdem_abstraction::get_indexer(const holdem_state::game_round round)
+{
     switch (round)
     {
-    case holdem_state::RIVER:
-        pos += sizeof(std::uint64_t) + turn_indexer_.get_size(turn_indexer_.get_rounds() - 1) * sizeof(bucket_idx_t);
-    case holdem_state::TURN:
-        pos += sizeof(std::uint64_t) + flop_indexer_.get_size(flop_indexer_.get_rounds() - 1) * sizeof(bucket_idx_t);
-    case holdem_state::FLOP:
-        pos += sizeof(std::uint64_t) + preflop_indexer_.get_size(preflop_indexer_.get_rounds() - 1)
-            * sizeof(bucket_idx_t);
     case holdem_state::PREFLOP:
-        pos += sizeof(std::uint64_t);
-        break;
+        return preflop_indexer_;
+    case holdem_state::FLOP:
+        return flop_indexer_;
+    case holdem_state::TURN:
+        return turn_indexer_;
+    case holdem_state::RIVER:
+        return river_indexer_;
     default:
         throw std::runtime_error("invalid round");
     }
-
-    pos += index * sizeof(bucket_idx_t);
-
-    return *reinterpret_cast<const bucket_idx_t*>(file_.data() + pos);
 }
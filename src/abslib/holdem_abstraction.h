@@ -1,5 +1,8 @@
 #pragma once
 
+#include <array>
+#include <vector>
+#include <cstdint>
 #include <boost/iostreams/device/mapped_file.hpp>
 #include "evallib/holdem_evaluator.h"
 #include "lutlib/hand_indexer.h"
@@ -13,16 +16,57 @@ public:
 
     typedef std::array<int, holdem_state::ROUNDS> bucket_counts_t;
 
+    struct kmeans_options
+    {
+        kmeans_options();
+
+        int max_iterations;
+        float tolerance;
+        int runs;
+        // k-means restarts run concurrently with this many threads each if > 0
+        int threads_per_run;
+        // the river is clustered with mini-batch k-means streaming from the memory mapped OCHS LUT if this is > 0
+        int river_batch_size;
+        int river_batch_iterations;
+        // also run full k-means on the river and report the cost difference to the mini-batch result
+        bool river_compare;
+    };
+
+    // .abs files written since version 2 start with this header; the bucket ids of each round are stored at the
+    // round's offset which is aligned to FILE_ALIGNMENT so that every round can be mapped with huge pages:
+    // [header][padding][preflop buckets][padding][flop buckets]...
+    struct header_type
+    {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t bucket_size; // bytes per bucket id, 2 if every bucket count fits in 16 bits and 4 otherwise
+        std::uint32_t imperfect_recall;
+        std::uint32_t reserved;
+        std::array<std::int32_t, holdem_state::ROUNDS> bucket_counts;
+        std::array<std::uint64_t, holdem_state::ROUNDS> offsets;
+        std::array<std::uint64_t, holdem_state::ROUNDS> sizes;
+    };
+
+    static const std::uint64_t HEADER_MAGIC = 0x534241534144494dull; // "MIDASABS"
+    static const std::uint32_t HEADER_VERSION = 2;
+    static const std::uint64_t FILE_ALIGNMENT = 2 * 1024 * 1024;
+
     holdem_abstraction();
     void get_buckets(int c0, int c1, int b0, int b1, int b2, int b3, int b4, bucket_type* buckets) const;
     int get_bucket_count(holdem_state::game_round round) const;
 
     void read(const std::string& filename);
-    void write(const std::string& filename, const int kmeans_max_iterations, float tolerance, int runs);
+    void write(const std::string& filename, const kmeans_options& options);
+
+    // writes the bucket ids of every round as a version 2 file, each round has one id per index of its indexer
+    static void write_buckets(const std::string& filename, bool imperfect_recall, const bucket_counts_t& bucket_counts,
+        const std::array<const std::vector<bucket_idx_t>*, holdem_state::ROUNDS>& buckets);
 
 private:
     bucket_idx_t read(holdem_state::game_round round, hand_indexer::hand_index_t index) const;
 
+    static const hand_indexer& get_indexer(holdem_state::game_round round);
+
     static const hand_indexer preflop_indexer_;
     static const hand_indexer flop_indexer_;
     static const hand_indexer turn_indexer_;
@@ -32,4 +76,7 @@ private:
     bucket_counts_t bucket_counts_;
 
     boost::iostreams::mapped_file_source file_;
+    std::size_t bucket_size_;
+    // start of the bucket ids of each round in the mapped file
+    std::array<const char*, holdem_state::ROUNDS> rounds_;
 };
@@ -12,6 +12,7 @@
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -56,6 +57,7 @@ int main(int argc, char* argv[])
         int threads;
         std::int64_t seed;
         std::string log_file;
+        std::string strategy_format;
 
         po::options_description desc("Options");
         desc.add_options()
@@ -64,6 +66,8 @@ int main(int argc, char* argv[])
             ("abstraction", po::value<std::string>(&abstraction)->required(), "abstraction type or file")
             ("iterations", po::value<std::uint64_t>(&iterations)->required(), "number of iterations")
             ("strategy-file", po::value<std::string>(&strategy_file)->required(), "strategy file")
+            ("strategy-format", po::value<std::string>(&strategy_format)->default_value("float"),
+                "strategy file format (float, uint16, uint8)")
             ("state-file", po::value<std::string>(&state_file), "state file")
             ("debug-file", po::value<std::string>(&debug_file), "debug output file")
             ("threads", po::value<int>(&threads)->default_value(omp_get_max_threads()), "number of threads")
@@ -101,6 +105,8 @@ int main(int argc, char* argv[])
 
         BOOST_LOG_TRIVIAL(info) << "cfr " << util::GIT_VERSION;
 
+        const auto format = strategy::parse_format(strategy_format);
+
         std::unique_ptr<solver_base> solver;
 
         BOOST_LOG_TRIVIAL(info) << "Creating solver for game: " << game;
@@ -201,8 +207,8 @@ int main(int argc, char* argv[])
             f << *solver;
         }
 
-        BOOST_LOG_TRIVIAL(info) << "Saving strategy to: " << strategy_file;
-        solver->save_strategy(strategy_file);
+        BOOST_LOG_TRIVIAL(info) << "Saving strategy to: " << strategy_file << " (" << strategy_format << ")";
+        solver->save_strategy(strategy_file, format, game, boost::filesystem::path(abstraction).stem().string());
 
         return 0;
     }
@@ -1,9 +1,6 @@
 #include <omp.h>
 #include "util/binary_io.h"
-
-#ifdef _MSC_VER
-#define ftello _ftelli64
-#endif
+#include "strategy_writer.h"
 
 namespace detail
 {
@@ -132,32 +129,27 @@ void cfr_solver<T, U, Data>::load_state(const std::string& filename)
 }
 
 template<class T, class U, class Data>
-void cfr_solver<T, U, Data>::save_strategy(const std::string& filename) const
+void cfr_solver<T, U, Data>::save_strategy(const std::string& filename, strategy::format_type format,
+    const std::string& game, const std::string& abstraction) const
 {
-    auto file = binary_open(filename, "wb");
-    std::vector<std::size_t> pointers;
+    strategy_writer writer(filename, strategy::create_header(format, game, abstraction, get_bucket_counts()));
 
     for (auto i = states_.begin(); i != states_.end(); ++i)
     {
         const auto& state = *i;
         assert(!state->is_terminal() && std::distance(states_.begin(), i) == state->get_id());
 
-        auto pos = ftello(file.get());
-
-        if (pos == -1)
-            throw std::runtime_error("invalid file position");
-
-        pointers.push_back(pos);
+        writer.add_state();
 
         for (int bucket = 0; bucket < abstraction_->get_bucket_count(state->get_round()); ++bucket)
         {
             std::vector<probability_t> p(state->get_child_count());
             get_average_strategy(*state, bucket, p.data());
-            binary_write(*file, p.data(), p.size());
+            writer.add_probabilities(p.data(), p.data() + p.size());
         }
     }
 
-    binary_write(*file, pointers.data(), pointers.size());
+    writer.close();
 }
 
 template<class T, class U, class Data>
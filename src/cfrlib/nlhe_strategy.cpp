@@ -13,27 +13,51 @@
 
 nlhe_strategy::nlhe_strategy(const std::string& filepath, bool read_only)
 {
-    const std::string filename = boost::filesystem::path(filepath).filename().string();
+    if (strategy::has_header(filepath))
+    {
+        // self-describing file, so the header is validated before building the tree
+        strategy_.reset(new strategy(filepath, read_only));
+        game_ = strategy_->get_game();
+        abstraction_name_ = strategy_->get_abstraction();
+    }
+    else
+    {
+        const std::string filename = boost::filesystem::path(filepath).filename().string();
 
-    boost::regex r("([^_]+)_([^_]+)(_.*)?\\.str");
-    boost::smatch m;
+        boost::regex r("([^_]+)_([^_]+)(_.*)?\\.str");
+        boost::smatch m;
 
-    if (!boost::regex_match(filename, m, r))
-        throw std::runtime_error("Unable to parse filename");
+        if (!boost::regex_match(filename, m, r))
+            throw std::runtime_error("Unable to parse filename");
 
-    root_state_ = nlhe_state::create(m[1].str());
+        game_ = m[1].str();
+        abstraction_name_ = m[2].str();
+    }
+
+    root_state_ = nlhe_state::create(game_);
     stack_size_ = root_state_->get_stack_size();
 
-    const auto state_count = nlhe_state::get_state_vector(*root_state_).size();
+    const auto state_count = static_cast<int>(nlhe_state::get_state_vector(*root_state_).size());
 
-    const auto abs_name = m[2].str();
+    if (!strategy_)
+        strategy_.reset(new strategy(filepath, state_count, read_only));
+    else if (strategy_->get_state_count() != state_count)
+        throw std::runtime_error("Strategy state count does not match game tree");
 
     auto dir = boost::filesystem::path(filepath).parent_path();
-    dir /= std::string(abs_name + ".abs");
+    dir /= std::string(abstraction_name_ + ".abs");
 
     abstraction_.reset(new holdem_abstraction);
     abstraction_->read(dir.string());
-    strategy_.reset(new strategy(filepath, state_count, read_only));
+
+    if (const auto header = strategy_->get_header())
+    {
+        for (int i = 0; i < holdem_state::ROUNDS; ++i)
+        {
+            if (header->bucket_counts[i] != abstraction_->get_bucket_count(static_cast<holdem_state::game_round>(i)))
+                throw std::runtime_error("Strategy bucket counts do not match abstraction");
+        }
+    }
 }
 
 const holdem_abstraction_base& nlhe_strategy::get_abstraction() const
@@ -60,3 +84,13 @@ int nlhe_strategy::get_stack_size() const
 {
     return stack_size_;
 }
+
+const std::string& nlhe_strategy::get_game() const
+{
+    return game_;
+}
+
+const std::string& nlhe_strategy::get_abstraction_name() const
+{
+    return abstraction_name_;
+}
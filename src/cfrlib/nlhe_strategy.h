@@ -16,10 +16,14 @@ public:
     const strategy& get_strategy() const;
     strategy& get_strategy();
     int get_stack_size() const;
+    const std::string& get_game() const;
+    const std::string& get_abstraction_name() const;
 
 private:
     std::unique_ptr<nlhe_state> root_state_;
     std::unique_ptr<holdem_abstraction_base> abstraction_;
     std::unique_ptr<strategy> strategy_;
     int stack_size_;
+    std::string game_;
+    std::string abstraction_name_;
 };
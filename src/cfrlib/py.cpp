@@ -1,8 +1,91 @@
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
 #include "nlhe_strategy.h"
 
 namespace py = pybind11;
 
+namespace
+{
+    std::vector<const game_state_base*> get_states(const py::list& states, const std::vector<int>& buckets)
+    {
+        if (states.size() != buckets.size())
+            throw std::runtime_error("states and buckets must have the same length");
+
+        std::vector<const game_state_base*> result(states.size());
+
+        for (std::size_t i = 0; i < result.size(); ++i)
+            result[i] = &states[i].cast<const game_state_base&>();
+
+        return result;
+    }
+
+    // float strategies are returned as a read-only view into the mapped file which keeps the strategy alive,
+    // quantized strategies are decoded into a new array
+    py::array get_probabilities(py::object self, const game_state_base& state, int bucket)
+    {
+        const auto& s = self.cast<const strategy&>();
+        const auto count = static_cast<std::size_t>(state.get_child_count());
+
+        if (s.get_format() == strategy::FLOAT_FORMAT)
+        {
+            const strategy::probability_t* p;
+
+            {
+                py::gil_scoped_release release;
+                p = s.get_data(state, 0, bucket);
+            }
+
+            py::array_t<strategy::probability_t> view(count, p, self);
+            view.attr("setflags")(py::arg("write") = false);
+            return view;
+        }
+
+        py::array_t<strategy::probability_t> result(count);
+        const auto p = result.mutable_data();
+
+        {
+            py::gil_scoped_release release;
+            s.get_probabilities(state, bucket, p);
+        }
+
+        return result;
+    }
+
+    // one row per (state, bucket) pair, padded with zeros to the largest child count
+    py::array get_probabilities_batch(const strategy& s, const py::list& states, const std::vector<int>& buckets)
+    {
+        const auto p = get_states(states, buckets);
+        int width = 0;
+
+        for (const auto state : p)
+            width = std::max(width, state->get_child_count());
+
+        py::array_t<strategy::probability_t> result(std::vector<std::size_t>{p.size(), std::size_t(width)});
+        const auto data = result.mutable_data();
+
+        {
+            py::gil_scoped_release release;
+            s.get_probabilities_batch(p.data(), buckets.data(), p.size(), width, data);
+        }
+
+        return result;
+    }
+
+    std::vector<int> get_random_children(const strategy& s, const py::list& states, const std::vector<int>& buckets)
+    {
+        const auto p = get_states(states, buckets);
+        std::vector<int> result(p.size());
+
+        {
+            py::gil_scoped_release release;
+            s.get_random_children(p.data(), buckets.data(), p.size(), result.data());
+        }
+
+        return result;
+    }
+}
+
 PYBIND11_PLUGIN(pycfrlib)
 {
     py::module m("pycfrlib", "midas Python plugin");
@@ -11,13 +94,19 @@ PYBIND11_PLUGIN(pycfrlib)
         .def(py::init<const std::string&, bool>())
         .def_property_readonly("abstraction", &nlhe_strategy::get_abstraction, py::return_value_policy::reference)
         .def_property_readonly("root_state", &nlhe_strategy::get_root_state, py::return_value_policy::reference)
-        .def_property_readonly("strategy", py::overload_cast<>(&nlhe_strategy::get_strategy), py::return_value_policy::reference)
+        .def_property_readonly("strategy", py::overload_cast<>(&nlhe_strategy::get_strategy), py::return_value_policy::reference_internal)
         .def_property_readonly("stack_size", &nlhe_strategy::get_stack_size)
         ;
 
     py::class_<strategy>(m, "Strategy")
         .def("get_probability", &strategy::get_probability)
-        .def("get_random_child", &strategy::get_random_child, py::return_value_policy::reference)
+        .def("get_probabilities", &get_probabilities)
+        .def("get_probabilities_batch", &get_probabilities_batch)
+        .def("get_random_child", [](const strategy& s, const game_state_base& state, int bucket) {
+            py::gil_scoped_release release;
+            return s.get_random_child(state, bucket);
+        })
+        .def("get_random_children", &get_random_children)
         .def_property_readonly("filename", &strategy::get_filename)
         ;
 
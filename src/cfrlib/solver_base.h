@@ -1,5 +1,7 @@
 #pragma once
 
+#include "strategy.h"
+
 static const double EPSILON = 1e-7;
 
 class solver_base
@@ -13,7 +15,8 @@ public:
     virtual void solve(const std::uint64_t iterations, std::int64_t seed, int threads = -1) = 0;
     virtual void save_state(const std::string& filename) const = 0;
     virtual void load_state(const std::string& filename) = 0;
-    virtual void save_strategy(const std::string& filename) const = 0;
+    virtual void save_strategy(const std::string& filename, strategy::format_type format, const std::string& game,
+        const std::string& abstraction) const = 0;
     virtual void init_storage() = 0;
     virtual std::vector<int> get_bucket_counts() const = 0;
     virtual std::vector<int> get_state_counts() const = 0;
@@ -2,27 +2,133 @@
 #include <cstdio>
 #include <cstdint>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <limits>
 #include "gamelib/game_state_base.h"
+#include "util/binary_io.h"
+#include "strategy_writer.h"
+
+static_assert(sizeof(strategy::header_type) == 176, "strategy header layout changed");
+
+const std::uint64_t strategy::HEADER_MAGIC;
+const std::uint32_t strategy::HEADER_VERSION;
+
+strategy::strategy(const std::string& filename, bool read_only)
+    : strategy(filename, -1, read_only)
+{
+}
 
 strategy::strategy(const std::string& filename, int states, bool read_only)
     : states_(states)
-    , engine_(std::random_device()())
-    , positions_(states)
     , file_(filename, read_only ? boost::iostreams::mapped_file::readonly : boost::iostreams::mapped_file::readwrite)
     , filename_(filename)
+    , format_(FLOAT_FORMAT)
+    , header_(nullptr)
+    , data_end_(0)
 {
     if (!file_)
         throw std::runtime_error("Unable to open strategy file");
 
-    const auto pos = file_.size() - std::int64_t(states) * sizeof(positions_[0]);
+    const auto size = file_.size();
+    auto end = size;
+
+    if (size >= sizeof(header_type)
+        && reinterpret_cast<const header_type*>(file_.const_data())->magic == HEADER_MAGIC)
+    {
+        header_ = reinterpret_cast<const header_type*>(file_.const_data());
+
+        if (header_->version != HEADER_VERSION)
+            throw std::runtime_error("Unsupported strategy file version");
+
+        if (header_->format > UINT8_FORMAT)
+            throw std::runtime_error("Unknown strategy format");
+
+        if (header_->positions_offset < sizeof(header_type)
+            || header_->positions_offset + header_->states * sizeof(std::uint64_t) != size)
+        {
+            throw std::runtime_error("Invalid strategy file size");
+        }
+
+        if (states != -1 && static_cast<std::uint64_t>(states) != header_->states)
+            throw std::runtime_error("Strategy state count mismatch");
+
+        states_ = static_cast<int>(header_->states);
+        format_ = static_cast<format_type>(header_->format);
+        end = header_->positions_offset + header_->states * sizeof(std::uint64_t);
+    }
+    else
+    {
+        // legacy files are headerless floats followed by the position table
+        if (states < 0)
+            throw std::runtime_error("Strategy file has no header");
+    }
+
+    if (end < std::uint64_t(states_) * sizeof(std::uint64_t))
+        throw std::runtime_error("Invalid strategy file size");
+
+    const auto pos = end - std::uint64_t(states_) * sizeof(std::uint64_t);
     const auto p = reinterpret_cast<const std::uint64_t*>(file_.const_data() + pos);
 
-    positions_.assign(p, p + positions_.size());
+    positions_.assign(p, p + states_);
+
+    if (!positions_.empty() && positions_.back() > pos)
+        throw std::runtime_error("Invalid strategy position table");
+
+    data_end_ = pos;
+    alias_tables_.reset(new std::atomic<const alias_table*>[states_]);
+
+    for (int i = 0; i < states_; ++i)
+        alias_tables_[i] = nullptr;
+}
+
+strategy::~strategy()
+{
+    for (int i = 0; i < states_; ++i)
+        delete alias_tables_[i].load();
 }
 
 strategy::probability_t strategy::get_probability(const game_state_base& state, int child, int bucket) const
 {
-    return *get_data(state, child, bucket);
+    if (format_ == FLOAT_FORMAT)
+        return *get_data(state, child, bucket);
+
+    return static_cast<probability_t>(get_quantized(get_position(state, child, bucket))
+        / double(get_quantization_scale(format_)));
+}
+
+void strategy::get_probabilities(const game_state_base& state, int bucket, probability_t* out) const
+{
+    const auto count = state.get_child_count();
+
+    if (format_ == FLOAT_FORMAT)
+    {
+        const auto p = get_data(state, 0, bucket);
+        std::copy(p, p + count, out);
+        return;
+    }
+
+    const auto position = get_position(state, 0, bucket);
+    const auto size = get_value_size(format_);
+    const double scale = get_quantization_scale(format_);
+
+    for (int i = 0; i < count; ++i)
+        out[i] = static_cast<probability_t>(get_quantized(position + i * size) / scale);
+}
+
+void strategy::get_probabilities_batch(const game_state_base* const states[], const int buckets[],
+    const std::size_t count, const int width, probability_t* out) const
+{
+    std::fill(out, out + count * width, probability_t(0));
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (states[i]->get_child_count() > width)
+            throw std::runtime_error("strategy batch row is too narrow");
+
+        get_probabilities(*states[i], buckets[i], out + i * width);
+    }
 }
 
 const strategy::probability_t* strategy::get_data(const game_state_base& state, int child, int bucket) const
@@ -30,6 +136,9 @@ const strategy::probability_t* strategy::get_data(const game_state_base& state,
     if (!file_.const_data())
         throw std::runtime_error("mapped file is null");
 
+    if (format_ != FLOAT_FORMAT)
+        throw std::runtime_error("raw data access requires a float strategy");
+
     return reinterpret_cast<const strategy::probability_t*>(file_.const_data() + get_position(state, child, bucket));
 }
 
@@ -38,10 +147,28 @@ strategy::probability_t* strategy::get_data(const game_state_base& state, int ch
     if (!file_.data())
         throw std::runtime_error("mapped file is null");
 
-    return reinterpret_cast<strategy::probability_t*>(file_.data() + get_position(state, child, bucket));
+    if (format_ != FLOAT_FORMAT)
+        throw std::runtime_error("raw data access requires a float strategy");
+
+    const auto position = get_position(state, child, bucket);
+
+    // the next draw from the state builds a new table from the written values
+    if (const auto table = alias_tables_[state.get_id()].exchange(nullptr))
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+        retired_alias_tables_.emplace_back(table);
+    }
+
+    return reinterpret_cast<strategy::probability_t*>(file_.data() + position);
 }
 
 int strategy::get_random_child(const game_state_base& state, int bucket) const
+{
+    static thread_local std::mt19937 engine(std::random_device{}());
+    return get_random_child(state, bucket, engine);
+}
+
+int strategy::get_random_child(const game_state_base& state, int bucket, std::mt19937& engine) const
 {
     if (state.get_id() >= states_ || bucket < 0)
     {
@@ -49,21 +176,145 @@ int strategy::get_random_child(const game_state_base& state, int bucket) const
         return -1;
     }
 
-    std::uniform_real_distribution<double> dist;
-    double x = dist(engine_);
+    const auto& table = get_alias_table(state);
+
+    if (bucket >= static_cast<int>(table.scales.size()))
+        throw std::runtime_error("invalid bucket");
+
+    const auto scale = table.scales[bucket];
+
+    if (scale == 0)
+        throw std::runtime_error("strategy row has no probability mass");
+
+    const auto offset = std::size_t(bucket) * table.children;
+    const auto column = static_cast<std::uint32_t>((std::uint64_t(engine()) * table.children) >> 32);
+    const auto coin = static_cast<std::uint32_t>((std::uint64_t(engine()) * scale) >> 32);
+
+    return coin < table.thresholds[offset + column] ? column : table.aliases[offset + column];
+}
+
+const strategy::alias_table& strategy::get_alias_table(const game_state_base& state) const
+{
+    auto& slot = alias_tables_[state.get_id()];
+
+    if (const auto table = slot.load(std::memory_order_acquire))
+        return *table;
+
+    // threads racing to build the same state publish the first table and drop their own
+    std::unique_ptr<const alias_table> table(new alias_table(create_alias_table(state)));
+    const alias_table* expected = nullptr;
+
+    if (slot.compare_exchange_strong(expected, table.get(), std::memory_order_acq_rel))
+        return *table.release();
+
+    return *expected;
+}
+
+strategy::alias_table strategy::create_alias_table(const game_state_base& state) const
+{
+    const auto count = static_cast<std::size_t>(state.get_child_count());
+
+    if (count == 0)
+        throw std::runtime_error("state has no children");
 
-    for (int i = 0; i < state.get_child_count(); ++i)
+    if (count > std::numeric_limits<std::uint8_t>::max() + std::size_t(1))
+        throw std::runtime_error("too many children for alias table");
+
+    // the rows of all buckets of a state are stored back to back up to the rows of the next state
+    const auto begin = positions_[state.get_id()];
+    const auto end = state.get_id() + 1 < states_ ? positions_[state.get_id() + 1] : data_end_;
+    const auto row_size = count * get_value_size(format_);
+
+    if (end < begin || (end - begin) % row_size != 0)
+        throw std::runtime_error("Invalid strategy position table");
+
+    const auto buckets = (end - begin) / row_size;
+
+    alias_table table;
+    table.children = static_cast<int>(count);
+    table.scales.resize(buckets);
+    table.thresholds.resize(buckets * count);
+    table.aliases.resize(buckets * count);
+
+    std::vector<std::uint32_t> weights(count);
+    std::vector<std::uint64_t> scaled(count);
+    std::vector<std::size_t> small;
+    std::vector<std::size_t> large;
+
+    for (std::size_t bucket = 0; bucket < buckets; ++bucket)
     {
-        const double p = get_probability(state, i, bucket);
+        const auto position = begin + bucket * row_size;
+        std::uint32_t scale = 0;
+
+        if (format_ == FLOAT_FORMAT)
+        {
+            const auto p = reinterpret_cast<const probability_t*>(file_.const_data() + position);
+
+            if (std::accumulate(p, p + count, 0.0) > 0)
+            {
+                // 2^31 keeps the scaled column weights within 32 bits for any realistic action count
+                scale = 0x80000000u;
+                strategy_writer::quantize(p, p + count, scale, weights.data());
+            }
+        }
+        else
+        {
+            // rows written by strategy_writer sum to the quantization scale but files edited in place may not
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                weights[i] = get_quantized(position + i * get_value_size(format_));
+                scale += weights[i];
+            }
+        }
+
+        table.scales[bucket] = scale;
 
-        if (x < p && p > 0)
-            return i;
+        if (scale == 0)
+            continue;
 
-        x -= p;
+        // each column has capacity scale and the total weight is exactly count * scale, so the integer version
+        // of Vose's algorithm terminates without any rounding leftovers
+        const auto thresholds = &table.thresholds[bucket * count];
+        const auto aliases = &table.aliases[bucket * count];
+        small.clear();
+        large.clear();
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            scaled[i] = std::uint64_t(weights[i]) * count;
+            thresholds[i] = scale;
+            aliases[i] = static_cast<std::uint8_t>(i);
+            (scaled[i] < scale ? small : large).push_back(i);
+        }
+
+        while (!small.empty() && !large.empty())
+        {
+            const auto s = small.back();
+            const auto l = large.back();
+            small.pop_back();
+
+            thresholds[s] = static_cast<std::uint32_t>(scaled[s]);
+            aliases[s] = static_cast<std::uint8_t>(l);
+            scaled[l] -= scale - scaled[s];
+
+            if (scaled[l] < scale)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+
+        assert(small.empty());
     }
 
-    // floating point errors might lead us here
-    return state.get_child_count() - 1;
+    return table;
+}
+
+void strategy::get_random_children(const game_state_base* const states[], const int buckets[],
+    const std::size_t count, int* out) const
+{
+    for (std::size_t i = 0; i < count; ++i)
+        out[i] = get_random_child(*states[i], buckets[i]);
 }
 
 std::string strategy::get_filename() const
@@ -71,6 +322,109 @@ std::string strategy::get_filename() const
     return filename_;
 }
 
+strategy::format_type strategy::get_format() const
+{
+    return format_;
+}
+
+int strategy::get_state_count() const
+{
+    return states_;
+}
+
+const strategy::header_type* strategy::get_header() const
+{
+    return header_;
+}
+
+std::string strategy::get_game() const
+{
+    return header_ ? std::string(header_->game.data(), strnlen(header_->game.data(), header_->game.size())) : "";
+}
+
+std::string strategy::get_abstraction() const
+{
+    return header_ ? std::string(header_->abstraction.data(),
+        strnlen(header_->abstraction.data(), header_->abstraction.size())) : "";
+}
+
+bool strategy::has_header(const std::string& filename)
+{
+    auto file = binary_open(filename, "rb");
+
+    if (!file)
+        throw std::runtime_error("Unable to open strategy file");
+
+    std::uint64_t magic;
+
+    if (std::fread(&magic, sizeof(magic), 1, file.get()) != 1)
+        return false;
+
+    return magic == HEADER_MAGIC;
+}
+
+strategy::header_type strategy::create_header(const format_type format, const std::string& game,
+    const std::string& abstraction, const std::vector<int>& bucket_counts)
+{
+    if (game.size() >= MAX_NAME_LENGTH || abstraction.size() >= MAX_NAME_LENGTH)
+        throw std::runtime_error("Strategy game or abstraction name is too long");
+
+    if (bucket_counts.size() > MAX_ROUNDS)
+        throw std::runtime_error("Too many rounds for strategy header");
+
+    header_type header;
+    std::memset(&header, 0, sizeof(header));
+
+    header.magic = HEADER_MAGIC;
+    header.version = HEADER_VERSION;
+    header.format = format;
+    std::copy(bucket_counts.begin(), bucket_counts.end(), header.bucket_counts.begin());
+    std::copy(game.begin(), game.end(), header.game.begin());
+    std::copy(abstraction.begin(), abstraction.end(), header.abstraction.begin());
+
+    return header;
+}
+
+std::size_t strategy::get_value_size(const format_type format)
+{
+    switch (format)
+    {
+    case FLOAT_FORMAT:
+        return sizeof(probability_t);
+    case UINT16_FORMAT:
+        return sizeof(std::uint16_t);
+    case UINT8_FORMAT:
+        return sizeof(std::uint8_t);
+    default:
+        throw std::runtime_error("invalid strategy format");
+    }
+}
+
+std::uint32_t strategy::get_quantization_scale(const format_type format)
+{
+    switch (format)
+    {
+    case UINT16_FORMAT:
+        return 0xffff;
+    case UINT8_FORMAT:
+        return 0xff;
+    default:
+        throw std::runtime_error("strategy format is not quantized");
+    }
+}
+
+strategy::format_type strategy::parse_format(const std::string& name)
+{
+    if (name == "float")
+        return FLOAT_FORMAT;
+    else if (name == "uint16")
+        return UINT16_FORMAT;
+    else if (name == "uint8")
+        return UINT8_FORMAT;
+    else
+        throw std::runtime_error("Unknown strategy format: " + name);
+}
+
 std::size_t strategy::get_position(const game_state_base& state, int child, int bucket) const
 {
     if (state.get_id() >= states_)
@@ -78,9 +432,19 @@ std::size_t strategy::get_position(const game_state_base& state, int child, int
 
     if (child < 0 || child >= state.get_child_count())
         throw std::runtime_error("invalid child");
-    
+
     if (bucket < 0)
         throw std::runtime_error("invalid bucket");
 
-    return positions_[state.get_id()] + (bucket * state.get_child_count() + child) * sizeof(strategy::probability_t);
+    return positions_[state.get_id()] + (bucket * state.get_child_count() + child) * get_value_size(format_);
+}
+
+std::uint32_t strategy::get_quantized(const std::size_t position) const
+{
+    const auto p = file_.const_data() + position;
+
+    if (format_ == UINT16_FORMAT)
+        return *reinterpret_cast<const std::uint16_t*>(p);
+    else
+        return *reinterpret_cast<const std::uint8_t*>(p);
 }
@@ -4,6 +4,9 @@
 #include <vector>
 #include <random>
 #include <memory>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
 #include <boost/iostreams/device/mapped_file.hpp>
 
 class game_state_base;
@@ -13,19 +16,88 @@ class strategy
 public:
     typedef float probability_t;
 
+    enum format_type
+    {
+        FLOAT_FORMAT, // 32-bit float per action
+        UINT16_FORMAT, // 16-bit fixed point per action, each (state, bucket) sums to 0xffff
+        UINT8_FORMAT, // 8-bit fixed point per action, each (state, bucket) sums to 0xff
+    };
+
+    static const int MAX_ROUNDS = 4;
+    static const std::size_t MAX_NAME_LENGTH = 64;
+
+    // files written since version 1 start with this header and end with the position table:
+    // [header][probabilities...][positions...]
+    struct header_type
+    {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t format;
+        std::uint64_t states;
+        std::uint64_t positions_offset;
+        std::array<std::int32_t, MAX_ROUNDS> bucket_counts;
+        std::array<char, MAX_NAME_LENGTH> game; // game tree configuration, e.g. "nlhe.fchpa.50"
+        std::array<char, MAX_NAME_LENGTH> abstraction; // abstraction file name without extension
+    };
+
+    static const std::uint64_t HEADER_MAGIC = 0x525453534144494dull; // "MIDASSTR"
+    static const std::uint32_t HEADER_VERSION = 1;
+
+    strategy(const std::string& filename, bool read_only = true);
     strategy(const std::string& filename, int states, bool read_only = true);
+    ~strategy();
     probability_t get_probability(const game_state_base& state, int child, int bucket) const;
+    void get_probabilities(const game_state_base& state, int bucket, probability_t* out) const;
     const probability_t* get_data(const game_state_base& state, int child, int bucket) const;
+    // rows of the state are sampled with the values written through the returned pointer from the next draw on
     probability_t* get_data(const game_state_base& state, int child, int bucket);
+    // rows of count (state, bucket) pairs, each padded with zeros to width values
+    void get_probabilities_batch(const game_state_base* const states[], const int buckets[], std::size_t count,
+        int width, probability_t* out) const;
     int get_random_child(const game_state_base& state, int bucket) const;
+    void get_random_children(const game_state_base* const states[], const int buckets[], std::size_t count,
+        int* out) const;
+    int get_random_child(const game_state_base& state, int bucket, std::mt19937& engine) const;
     std::string get_filename() const;
+    format_type get_format() const;
+    int get_state_count() const;
+    const header_type* get_header() const;
+    std::string get_game() const;
+    std::string get_abstraction() const;
+
+    static bool has_header(const std::string& filename);
+    static header_type create_header(format_type format, const std::string& game, const std::string& abstraction,
+        const std::vector<int>& bucket_counts);
+    static std::size_t get_value_size(format_type format);
+    static std::uint32_t get_quantization_scale(format_type format);
+    static format_type parse_format(const std::string& name);
 
 private:
+    // Walker/Vose alias tables of every bucket of a state over integer weights so that sampling is a single column
+    // pick and one integer comparison regardless of the action count
+    struct alias_table
+    {
+        int children;
+        std::vector<std::uint32_t> scales; // per bucket, 0 if the row has no probability mass
+        std::vector<std::uint32_t> thresholds; // per bucket and column
+        std::vector<std::uint8_t> aliases;
+    };
+
+    const alias_table& get_alias_table(const game_state_base& state) const;
+    alias_table create_alias_table(const game_state_base& state) const;
     std::size_t get_position(const game_state_base& state, int child, int bucket) const;
+    std::uint32_t get_quantized(std::size_t position) const;
 
     int states_;
-    mutable std::mt19937 engine_;
     std::vector<std::size_t> positions_;
     boost::iostreams::mapped_file file_;
     std::string filename_;
+    format_type format_;
+    const header_type* header_;
+    std::size_t data_end_;
+    // one slot per state which is filled on the first draw from the state, so draws never lock; tables replaced
+    // after a write through get_data() are kept until destruction as concurrent draws may still be reading them
+    std::unique_ptr<std::atomic<const alias_table*>[]> alias_tables_;
+    std::vector<std::unique_ptr<const alias_table>> retired_alias_tables_;
+    std::mutex retired_mutex_;
 };
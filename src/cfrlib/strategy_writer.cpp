@@ -0,0 +1,108 @@
+#include "strategy_writer.h"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cassert>
+#include "util/binary_io.h"
+
+strategy_writer::strategy_writer(const std::string& filename, const strategy::header_type& header)
+    : file_(binary_open(filename, "wb"))
+    , header_(header)
+    , format_(static_cast<strategy::format_type>(header.format))
+    , position_(sizeof(header))
+{
+    if (!file_)
+        throw std::runtime_error("Unable to create strategy file");
+
+    // the header is rewritten with the final state count and position table offset on close
+    binary_write(*file_, header_);
+}
+
+void strategy_writer::add_state()
+{
+    positions_.push_back(position_);
+}
+
+void strategy_writer::add_probabilities(const probability_t* begin, const probability_t* end)
+{
+    const auto count = static_cast<std::size_t>(end - begin);
+
+    switch (format_)
+    {
+    case strategy::FLOAT_FORMAT:
+        binary_write(*file_, begin, count);
+        break;
+    case strategy::UINT16_FORMAT:
+        {
+            quantized_.resize(count);
+            quantize(begin, end, strategy::get_quantization_scale(format_), quantized_.data());
+            std::vector<std::uint16_t> values(quantized_.begin(), quantized_.end());
+            binary_write(*file_, values.data(), values.size());
+        }
+        break;
+    case strategy::UINT8_FORMAT:
+        {
+            quantized_.resize(count);
+            quantize(begin, end, strategy::get_quantization_scale(format_), quantized_.data());
+            std::vector<std::uint8_t> values(quantized_.begin(), quantized_.end());
+            binary_write(*file_, values.data(), values.size());
+        }
+        break;
+    default:
+        throw std::runtime_error("invalid strategy format");
+    }
+
+    position_ += count * strategy::get_value_size(format_);
+}
+
+void strategy_writer::close()
+{
+    if (!file_)
+        return;
+
+    binary_write(*file_, positions_.data(), positions_.size());
+
+    header_.states = positions_.size();
+    header_.positions_offset = position_;
+
+    if (std::fseek(file_.get(), 0, SEEK_SET) != 0)
+        throw std::runtime_error("Unable to write strategy header");
+
+    binary_write(*file_, header_);
+
+    file_.reset();
+}
+
+// largest remainder rounding so that the quantized values always sum to exactly scale, which keeps each
+// probability within 1 / scale of the normalized input
+void strategy_writer::quantize(const probability_t* begin, const probability_t* end, const std::uint32_t scale,
+    std::uint32_t* out)
+{
+    const auto count = static_cast<std::size_t>(end - begin);
+
+    if (count == 0)
+        return;
+
+    const double sum = std::accumulate(begin, end, 0.0);
+    std::vector<std::pair<double, std::size_t>> remainders(count);
+    std::uint32_t total = 0;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const double x = sum > 0 ? begin[i] / sum * scale : double(scale) / count;
+        out[i] = static_cast<std::uint32_t>(std::floor(x));
+        remainders[i] = std::make_pair(x - out[i], i);
+        total += out[i];
+    }
+
+    assert(total <= scale);
+
+    std::sort(remainders.begin(), remainders.end(), [](const std::pair<double, std::size_t>& a,
+        const std::pair<double, std::size_t>& b)
+    {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+
+    for (std::size_t i = 0; total < scale; i = (i + 1) % count, ++total)
+        ++out[remainders[i].second];
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include "strategy.h"
+
+class strategy_writer
+{
+public:
+    typedef strategy::probability_t probability_t;
+
+    strategy_writer(const std::string& filename, const strategy::header_type& header);
+    void add_state();
+    void add_probabilities(const probability_t* begin, const probability_t* end);
+    void close();
+
+    static void quantize(const probability_t* begin, const probability_t* end, std::uint32_t scale,
+        std::uint32_t* out);
+
+private:
+    std::unique_ptr<FILE, int (*)(FILE*)> file_;
+    strategy::header_type header_;
+    strategy::format_type format_;
+    std::vector<std::uint64_t> positions_;
+    std::uint64_t position_;
+    std::vector<std::uint32_t> quantized_;
+};
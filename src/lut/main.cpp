@@ -1,11 +1,23 @@
+#ifdef _MSC_VER
+#pragma warning(push, 1)
+#endif
 #include <random>
 #include <iostream>
 #include <fstream>
 #include <numeric>
+#include <limits>
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
 #include "evallib/holdem_evaluator.h"
 #include "lutlib/holdem_river_lut.h"
 #include "util/partial_shuffle.h"
 #include "lutlib/holdem_river_ochs_lut.h"
+#include "lutlib/holdem_turn_lut.h"
+#include "lutlib/holdem_flop_lut.h"
+#include "lutlib/lut_parts.h"
 #include "util/version.h"
 #include "gamelib/holdem_state.h"
 
@@ -46,48 +58,243 @@ namespace
             }
         }
     }
-}
 
-int main(int argc, char* argv[])
-{
-    std::cout << "lut " << util::GIT_VERSION << "\n";
+    // mean river equity and its square over all ways to complete the board from the river LUT
+    std::array<double, 2> enumerate_rivers(const holdem_river_lut& river_lut, std::array<int, 7> cards, const int board)
+    {
+        std::array<double, 2> sum = {{}};
+        int count = 0;
 
-    if (argc != 3)
-        return 1;
+        for (int c = 0; c < 52; ++c)
+        {
+            if (std::find(cards.begin(), cards.begin() + board, c) != cards.begin() + board)
+                continue;
 
-    const bool generate = std::stoi(argv[1]) ? true : false;
-    const int round = std::stoi(argv[2]);
+            cards[board] = c;
 
-    if (generate)
-    {
-        switch (round)
-        {
-        case 0:
+            if (board < 6)
             {
-                holdem_river_lut lut;
-                lut.save("holdem_river_lut.dat");
+                const auto value = enumerate_rivers(river_lut, cards, board + 1);
+                sum[0] += value[0];
+                sum[1] += value[1];
             }
-            break;
-        case 1:
+            else
             {
-                holdem_river_ochs_lut lut;
-                lut.save("holdem_river_ochs_lut.dat");
+                const double value = river_lut.get(cards);
+                sum[0] += value;
+                sum[1] += value * value;
             }
-            break;
+
+            ++count;
         }
+
+        return {{sum[0] / count, sum[1] / count}};
     }
-    else
+
+    // compares the turn or flop LUT against enumerating the river LUT for random hands of CARDS cards
+    template<int CARDS, class Lut>
+    void test_ehs(const Lut& lut, const holdem_river_lut& river_lut, const int iterations)
     {
-        switch (round)
+        std::array<int, 52> deck;
+        std::iota(deck.begin(), deck.end(), 0);
+
+        // quantized tables round the values to multiples of 1 / lut_file::UNIT_SCALE
+        const double tolerance = lut.get_format() == lut_file::LUT_FLOAT ? 1e-6
+            : 0.5 / lut_file::UNIT_SCALE + std::numeric_limits<float>::epsilon();
+
+#pragma omp parallel firstprivate(deck)
         {
-        case 0:
+            std::random_device rd;
+            std::mt19937 engine(rd());
+
+#pragma omp for
+            for (int i = 0; i < iterations; ++i)
             {
-                const holdem_river_lut lut("holdem_river_lut.dat");
-                test_river(lut);
+                partial_shuffle(deck, CARDS, engine);
+
+                std::array<int, CARDS> cards;
+                std::array<int, 7> river_cards;
+                std::copy(deck.end() - CARDS, deck.end(), cards.begin());
+                std::copy(cards.begin(), cards.end(), river_cards.begin());
+
+                const auto real = enumerate_rivers(river_lut, river_cards, CARDS);
+                const auto cached = lut.get(cards);
+
+                for (int j = 0; j < 2; ++j)
+                {
+                    if (std::abs(real[j] - cached[j]) > tolerance)
+                    {
+#pragma omp critical
+                        std::cout << "hand: " << cards[0] << " " << cards[1] << " | " << cards[2] << " " << cards[3]
+                            << " " << cards[4] << (CARDS == 6 ? " " + std::to_string(cards[5]) : "") << " value " << j
+                            << " real: " << real[j] << " cached: " << cached[j] << "\n";
+                    }
+                }
             }
-            break;
         }
     }
-        
-    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        namespace po = boost::program_options;
+
+        std::string lut;
+        std::string mode;
+        std::string filename;
+        std::string format_name;
+        std::string output;
+        std::string river_filename;
+        std::string turn_filename;
+        int parts;
+        std::vector<int> selected_parts;
+
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help", "produce help message")
+            ("lut", po::value<std::string>(&lut)->required(), "lut (river, river-ochs, turn, flop)")
+            ("mode", po::value<std::string>(&mode)->default_value("generate"), "mode (generate, merge, verify, convert)")
+            ("file", po::value<std::string>(&filename), "lut file (default holdem_<lut>_lut.dat)")
+            ("format", po::value<std::string>(&format_name)->default_value("float"),
+                "format of written lut files (float, uint16, packed)")
+            ("output", po::value<std::string>(&output), "output file of convert mode")
+            ("river-file", po::value<std::string>(&river_filename)->default_value("holdem_river_lut.dat"),
+                "river lut the turn lut is generated from and turn and flop luts are verified against")
+            ("turn-file", po::value<std::string>(&turn_filename)->default_value("holdem_turn_lut.dat"),
+                "turn lut the flop lut is generated from")
+            ("parts", po::value<int>(&parts)->default_value(0),
+                "split generation into this many part files, see --part (0 = generate the whole lut in memory)")
+            ("part", po::value<std::vector<int>>(&selected_parts)->multitoken(),
+                "parts to generate in this process (default all); complete parts and parts locked by another process "
+                "are skipped")
+            ("version", "show version")
+            ;
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+
+        if (vm.count("help"))
+        {
+            std::cout << desc << "\n";
+            return 0;
+        }
+
+        if (vm.count("version"))
+        {
+            std::cout << util::GIT_VERSION << "\n";
+            return 0;
+        }
+
+        po::notify(vm);
+
+        std::cout << "lut " << util::GIT_VERSION << "\n";
+
+        if (lut != "river" && lut != "river-ochs" && lut != "turn" && lut != "flop")
+            throw std::runtime_error("Invalid lut");
+
+        if (filename.empty())
+            filename = "holdem_" + boost::replace_all_copy(lut, "-", "_") + "_lut.dat";
+
+        const bool ochs = lut == "river-ochs";
+        // turn and flop luts are aggregated from the previous street in memory and can't be built in parts
+        const bool river = lut == "river" || ochs;
+        const auto format = lut_file::parse_format(format_name);
+
+        if (mode == "generate" && !river)
+        {
+            if (parts != 0 || !selected_parts.empty())
+                throw std::runtime_error("Only river luts can be generated in parts");
+
+            if (lut == "turn")
+                holdem_turn_lut(holdem_river_lut(river_filename, true)).save(filename, format);
+            else
+                holdem_flop_lut(holdem_turn_lut(turn_filename, true)).save(filename, format);
+        }
+        else if (mode == "generate")
+        {
+            if (parts == 0 && !std::ifstream(filename + ".manifest"))
+            {
+                if (!selected_parts.empty())
+                    throw std::runtime_error("--part requires --parts");
+
+                if (ochs)
+                    holdem_river_ochs_lut().save(filename, format);
+                else
+                    holdem_river_lut().save(filename, format);
+            }
+            else
+            {
+                // a build in progress is resumed with the part count of its manifest
+                const auto manifest = open_lut_manifest(filename, lut, parts);
+
+                if (selected_parts.empty())
+                {
+                    selected_parts.resize(manifest.parts);
+                    std::iota(selected_parts.begin(), selected_parts.end(), 0);
+                }
+
+                for (const auto part : selected_parts)
+                {
+                    if (ochs)
+                        create_lut_part<holdem_river_ochs_lut>(filename, manifest, part);
+                    else
+                        create_lut_part<holdem_river_lut>(filename, manifest, part);
+                }
+            }
+        }
+        else if (mode == "merge")
+        {
+            if (!river)
+                throw std::runtime_error("Only river luts are built in parts");
+
+            const auto manifest = read_lut_manifest(filename);
+
+            if (manifest.lut != lut)
+                throw std::runtime_error("LUT manifest is for a different lut");
+
+            if (ochs)
+                merge_lut_parts<holdem_river_ochs_lut>(filename, manifest, format);
+            else
+                merge_lut_parts<holdem_river_lut>(filename, manifest, format);
+        }
+        else if (mode == "verify")
+        {
+            if (ochs)
+                throw std::runtime_error("The river OCHS lut can't be verified");
+
+            if (lut == "turn")
+                test_ehs<6>(holdem_turn_lut(filename), holdem_river_lut(river_filename), 100000);
+            else if (lut == "flop")
+                test_ehs<5>(holdem_flop_lut(filename), holdem_river_lut(river_filename), 10000);
+            else
+                test_river(holdem_river_lut(filename));
+        }
+        else if (mode == "convert")
+        {
+            if (output.empty() || output == filename)
+                throw std::runtime_error("Convert requires a different --output file");
+
+            if (ochs)
+                holdem_river_ochs_lut(filename, true).save(output, format);
+            else if (lut == "turn")
+                holdem_turn_lut(filename, true).save(output, format);
+            else if (lut == "flop")
+                holdem_flop_lut(filename, true).save(output, format);
+            else
+                holdem_river_lut(filename, true).save(output, format);
+        }
+        else
+        {
+            throw std::runtime_error("Invalid mode");
+        }
+
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
 }
@@ -3,6 +3,10 @@
 #include <cassert>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 
 #ifdef _MSC_VER
 #include <intrin.h>
@@ -11,6 +15,8 @@
 
 #define MAX_ROUNDS           8
 
+static_assert(MAX_ROUNDS == hand_indexer::MAX_HAND_ROUNDS, "round limits differ");
+
 void hand_indexer_state_init(const hand_indexer_t * indexer, hand_indexer_state_t * state);
 
 struct hand_indexer_t {
@@ -24,11 +30,20 @@ struct hand_indexer_t {
     hand_indexer::hand_index_t * configuration_to_offset[MAX_ROUNDS];
 };
 
-struct hand_indexer_state_t {
-    uint_fast32_t suit_index[SUITS];
-    uint_fast32_t suit_multiplier[SUITS];
-    uint_fast32_t round, permutation_index, permutation_multiplier;
-    uint32_t used_ranks[SUITS];
+static const unsigned int MAX_GROUP_INDEX = 0x100000;
+static const unsigned int SUIT_PERMUTATIONS = 1*2*3*4;
+
+// tables which only depend on the deck are built once on first use and shared by every indexer
+struct hand_indexer_tables_t {
+    hand_indexer_tables_t();
+
+    std::array<std::array<std::uint8_t, RANKS>, 1 << RANKS> nth_unset;
+    std::array<std::array<bool, SUITS>, 1 << (SUITS - 1)> equal;
+    std::array<std::array<std::uint32_t, RANKS + 1>, RANKS + 1> nCr_ranks;
+    std::array<std::uint32_t, 1 << RANKS> rank_set_to_index;
+    std::array<std::array<std::uint32_t, 1 << RANKS>, RANKS + 1> index_to_rank_set;
+    std::array<std::array<uint_fast32_t, SUITS>, SUIT_PERMUTATIONS> suit_permutations;
+    std::array<std::array<hand_indexer::hand_index_t, SUITS + 1>, MAX_GROUP_INDEX> nCr_groups;
 };
 
 #ifdef _MSC_VER
@@ -57,6 +72,8 @@ double log(hand_indexer::hand_index_t n)
 
 static const int ROUND_SHIFT = 4;
 static const int ROUND_MASK = 0xf;
+static const uint64_t SUIT_RANKS_MASK = 0x1111111111111ull;
+static const std::size_t BATCH_SIZE = 16;
 
 template<class Function>
 void enumerate_configurations_r(std::size_t rounds, const std::uint8_t cards_per_round[], 
@@ -144,17 +161,17 @@ out:;
         hand_index_t size = 1;
         for(uint_fast32_t j=0, remaining=RANKS; j<=round; ++j) {
             uint_fast32_t ranks = configuration[i]>>ROUND_SHIFT*(indexer->rounds-j-1)&ROUND_MASK;
-            size *= nCr_ranks[remaining][ranks];
+            size *= tables->nCr_ranks[remaining][ranks];
             remaining -= ranks;
         }
-        assert(size+SUITS-1 < hand_indexer::MAX_GROUP_INDEX);
+        assert(size+SUITS-1 < MAX_GROUP_INDEX);
 
         uint_fast32_t j=i+1; for(; j<SUITS && configuration[j] == configuration[i]; ++j) {} 
         for(uint_fast32_t k=i; k<j; ++k) {
             indexer->configuration_to_suit_size[round][id][k] = static_cast<uint_fast32_t>(size);
         }
 
-        indexer->configuration_to_offset[round][id] *= nCr_groups[size+j-i-1][j-i];
+        indexer->configuration_to_offset[round][id] *= tables->nCr_groups[size+j-i-1][j-i];
 
         for(uint_fast32_t k=i+1; k<j; ++k) {
             equal |= 1<<k;
@@ -299,6 +316,11 @@ void hand_indexer_state_init(const hand_indexer_t *, hand_indexer_state_t * stat
     }
 }
 
+void hand_indexer::hand_index_init(hand_indexer_state_t * state) const
+{
+    hand_indexer_state_init(indexer, state);
+}
+
 hand_indexer::hand_index_t hand_indexer::hand_index_all(const uint8_t cards[], hand_index_t indices[]) const
 {
     if (indexer->rounds) {
@@ -320,12 +342,51 @@ hand_indexer::hand_index_t hand_indexer::hand_index_last(const card_t cards[]) c
     return hand_index_all(cards, indices);
 }
 
-hand_indexer::hand_index_t hand_indexer::hand_index_next_round(const uint8_t cards[], hand_indexer_state_t * state) const
+void hand_indexer::hand_index_batch(int round, const card_t hands[], std::size_t count, hand_index_t indices[]) const
+{
+    assert(round < static_cast<int>(indexer->rounds));
+
+    const std::size_t stride = indexer->round_start[round] + indexer->cards_per_round[round];
+
+    /* hands are advanced a round at a time over small groups so that the table lookups of independent hands
+       overlap instead of serializing on one hand's dependency chain */
+    for(std::size_t begin=0; begin<count; begin+=BATCH_SIZE) {
+        const std::size_t size = std::min(BATCH_SIZE, count-begin);
+        const card_t * group = hands + begin*stride;
+        hand_indexer_state_t states[BATCH_SIZE];
+
+        for(std::size_t i=0; i<size; ++i) {
+            hand_indexer_state_init(indexer, &states[i]);
+        }
+
+        for(int j=0; j<=round; ++j) {
+            for(std::size_t i=0; i<size; ++i) {
+                indices[begin+i] = hand_index_next_round(group + i*stride + indexer->round_start[j], &states[i]);
+            }
+        }
+    }
+}
+
+hand_indexer::hand_index_t hand_indexer::hand_index_next_round(const card_t cards[], hand_indexer_state_t * state) const
 {
     uint_fast32_t round = state->round++;
     assert(round < indexer->rounds);
 
     uint_fast32_t ranks[SUITS] = {0}, shifted_ranks[SUITS] = {0};
+#ifdef __BMI2__
+    /* cards are rank<<2|suit so the ranks of a suit are every fourth bit of the card set, and the shifted ranks
+       are the ranks with the used ones squeezed out */
+    uint64_t card_set = 0;
+    for(uint_fast32_t i=0; i<indexer->cards_per_round[round]; ++i) {
+        assert(cards[i] < CARDS);                 /* valid card */
+        card_set |= 1ull<<cards[i];
+    }
+
+    for(uint_fast32_t i=0; i<SUITS; ++i) {
+        ranks[i]                   = static_cast<uint_fast32_t>(_pext_u64(card_set, SUIT_RANKS_MASK<<i));
+        shifted_ranks[i]           = _pext_u32(static_cast<uint32_t>(ranks[i]), ~state->used_ranks[i]);
+    }
+#else
     for(uint_fast32_t i=0; i<indexer->cards_per_round[round]; ++i) {
         assert(cards[i] < CARDS);                 /* valid card */
 
@@ -333,13 +394,14 @@ hand_indexer::hand_index_t hand_indexer::hand_index_next_round(const uint8_t car
         ranks[suit]               |= rank_bit;
         shifted_ranks[suit]       |= rank_bit>>__builtin_popcount((rank_bit-1)&state->used_ranks[suit]);
     }
+#endif
 
     for(uint_fast32_t i=0; i<SUITS; ++i) {
         assert(!(state->used_ranks[i]&ranks[i])); /* no duplicate cards */
 
         uint_fast32_t used_size    = __builtin_popcount(state->used_ranks[i]), this_size = __builtin_popcount(ranks[i]);
-        state->suit_index[i]      += state->suit_multiplier[i]*rank_set_to_index[shifted_ranks[i]];
-        state->suit_multiplier[i] *= nCr_ranks[RANKS-used_size][this_size];
+        state->suit_index[i]      += state->suit_multiplier[i]*tables->rank_set_to_index[shifted_ranks[i]];
+        state->suit_multiplier[i] *= tables->nCr_ranks[RANKS-used_size][this_size];
         state->used_ranks[i]      |= ranks[i];
     }
 
@@ -354,7 +416,7 @@ hand_indexer::hand_index_t hand_indexer::hand_index_next_round(const uint8_t car
     uint_fast32_t pi_index      = indexer->permutation_to_pi[round][state->permutation_index];
     uint_fast32_t equal_index   = indexer->configuration_to_equal[round][configuration];
     hand_index_t offset         = indexer->configuration_to_offset[round][configuration];
-    const uint_fast32_t * pi    = suit_permutations[pi_index];
+    const uint_fast32_t * pi    = tables->suit_permutations[pi_index].data();
 
     hand_index_t suit_index[SUITS], suit_multiplier[SUITS];
     for(uint_fast32_t i=0; i<SUITS; ++i) {
@@ -376,26 +438,26 @@ hand_indexer::hand_index_t hand_indexer::hand_index_next_round(const uint8_t car
     for(uint_fast32_t i=0; i<SUITS;) {
         hand_index_t part, size;
 
-        if (i+1 < SUITS && equal[equal_index][i+1]) {
-            if (i+2 < SUITS && equal[equal_index][i+2]) {
-                if (i+3 < SUITS && equal[equal_index][i+3]) {
+        if (i+1 < SUITS && tables->equal[equal_index][i+1]) {
+            if (i+2 < SUITS && tables->equal[equal_index][i+2]) {
+                if (i+3 < SUITS && tables->equal[equal_index][i+3]) {
                     /* four equal suits */
                     swap(i, i+1); swap(i+2, i+3); swap(i, i+2); swap(i+1, i+3); swap(i+1, i+2);
-                    part = suit_index[i] + nCr_groups[suit_index[i+1]+1][2] + nCr_groups[suit_index[i+2]+2][3] + nCr_groups[suit_index[i+3]+3][4];
-                    size = nCr_groups[suit_multiplier[i]+3][4];
+                    part = suit_index[i] + tables->nCr_groups[suit_index[i+1]+1][2] + tables->nCr_groups[suit_index[i+2]+2][3] + tables->nCr_groups[suit_index[i+3]+3][4];
+                    size = tables->nCr_groups[suit_multiplier[i]+3][4];
                     i += 4;
                 } else {
                     /* three equal suits */
                     swap(i, i+1); swap(i, i+2); swap(i+1, i+2);
-                    part = suit_index[i] + nCr_groups[suit_index[i+1]+1][2] + nCr_groups[suit_index[i+2]+2][3];
-                    size = nCr_groups[suit_multiplier[i]+2][3];
+                    part = suit_index[i] + tables->nCr_groups[suit_index[i+1]+1][2] + tables->nCr_groups[suit_index[i+2]+2][3];
+                    size = tables->nCr_groups[suit_multiplier[i]+2][3];
                     i += 3;
                 }
             } else {
                 /* two equal suits*/
                 swap(i, i+1);
-                part = suit_index[i] + nCr_groups[suit_index[i+1]+1][2];
-                size = nCr_groups[suit_multiplier[i]+1][2];
+                part = suit_index[i] + tables->nCr_groups[suit_index[i+1]+1][2];
+                size = tables->nCr_groups[suit_multiplier[i]+1][2];
                 i += 2;
             }
         } else {
@@ -414,12 +476,7 @@ hand_indexer::hand_index_t hand_indexer::hand_index_next_round(const uint8_t car
     return index;
 }
 
-bool hand_indexer::hand_unindex(int round, hand_index_t index, card_t cards[]) const
-{
-    if (round >= static_cast<int>(indexer->rounds) || index >= indexer->round_size[round]) {
-        return false;
-    }
-
+static uint_fast32_t find_configuration(const hand_indexer_t * indexer, uint_fast32_t round, hand_indexer::hand_index_t index) {
     uint_fast32_t low = 0, high = indexer->configurations[round], configuration_idx = 0;
     while(low < high) {
         uint_fast32_t mid = (low+high)/2;
@@ -430,66 +487,182 @@ bool hand_indexer::hand_unindex(int round, hand_index_t index, card_t cards[]) c
             high = mid;
         }
     }
+    return configuration_idx;
+}
+
+void hand_indexer::unindex_group(uint_fast32_t suit_size, uint_fast32_t i, uint_fast32_t j, hand_index_t group_index, hand_index_t suit_index[]) const
+{
+    uint_fast32_t low, high;
+    for(; i<j-1; ++i) {
+        suit_index[i] = low = floor(exp(log(group_index)/(j-i) - 1 + log(j-i))-j-i); high = ceil(exp(log(group_index)/(j-i) + log(j-i))-j+i+1);
+        if (high > suit_size) {
+            high = suit_size;
+        }
+        if (high <= low) {
+            low = 0;
+        }
+        while(low < high) {
+            uint_fast32_t mid = (low+high)/2;
+            if (tables->nCr_groups[mid+j-i-1][j-i] <= group_index) {
+                suit_index[i] = mid;
+                low = mid+1;
+            } else {
+                high = mid;
+            }
+        }
+
+        //for(suit_index[i]=0; nCr_groups[suit_index[i]+1+j-i-1][j-i] <= group_index; ++suit_index[i]) {}
+        group_index -= tables->nCr_groups[suit_index[i]+j-i-1][j-i]; 
+    }
+
+    suit_index[i] = group_index;
+}
+
+void hand_indexer::unindex_suit(const uint_fast32_t configuration[], uint_fast32_t suit, hand_index_t suit_index, uint8_t location[], card_t cards[]) const
+{
+    uint_fast32_t used = 0, m = 0;
+    for(uint_fast32_t j=0; j<indexer->rounds; ++j) {
+        uint_fast32_t n              = configuration[suit]>>ROUND_SHIFT*(indexer->rounds-j-1)&ROUND_MASK;
+        uint_fast32_t round_size     = tables->nCr_ranks[RANKS-m][n]; m += n;
+        uint_fast32_t round_idx      = suit_index%round_size; suit_index /= round_size;
+        uint_fast32_t shifted_cards  = tables->index_to_rank_set[n][round_idx], rank_set = 0;
+        for(uint_fast32_t k=0; k<n; ++k) {
+            uint_fast32_t shifted_card = shifted_cards&-shifted_cards; shifted_cards ^= shifted_card;
+            uint_fast32_t card         = tables->nth_unset[used][__builtin_ctz(shifted_card)]; rank_set |= 1<<card;
+            cards[location[j]++]       = get_card(card, suit);
+        }
+        used |= rank_set;
+    }
+}
+
+bool hand_indexer::hand_unindex(int round, hand_index_t index, card_t cards[]) const
+{
+    if (round >= static_cast<int>(indexer->rounds) || index >= indexer->round_size[round]) {
+        return false;
+    }
+
+    uint_fast32_t configuration_idx = find_configuration(indexer, round, index);
     index -= indexer->configuration_to_offset[round][configuration_idx];
 
+    const uint_fast32_t * configuration = indexer->configuration[round][configuration_idx];
+
     hand_index_t suit_index[SUITS];
     for(uint_fast32_t i=0; i<SUITS;) {
-        uint_fast32_t j=i+1; for(; j<SUITS && indexer->configuration[round][configuration_idx][j] == indexer->configuration[round][configuration_idx][i]; ++j) {}
+        uint_fast32_t j=i+1; for(; j<SUITS && configuration[j] == configuration[i]; ++j) {}
 
         uint_fast32_t suit_size  = indexer->configuration_to_suit_size[round][configuration_idx][i];
-        hand_index_t group_size  = nCr_groups[suit_size+j-i-1][j-i];
+        hand_index_t group_size  = tables->nCr_groups[suit_size+j-i-1][j-i];
         hand_index_t group_index = index%group_size; index /= group_size;
 
-        for(; i<j-1; ++i) {
-            suit_index[i] = low = floor(exp(log(group_index)/(j-i) - 1 + log(j-i))-j-i); high = ceil(exp(log(group_index)/(j-i) + log(j-i))-j+i+1);
-            if (high > suit_size) {
-                high = suit_size;
-            }
-            if (high <= low) {
-                low = 0;
-            }
-            while(low < high) {
-                uint_fast32_t mid = (low+high)/2;
-                if (nCr_groups[mid+j-i-1][j-i] <= group_index) {
-                    suit_index[i] = mid;
-                    low = mid+1;
-                } else {
-                    high = mid;
-                }
-            }
+        unindex_group(suit_size, i, j, group_index, suit_index);
+        i = j;
+    }
+
+    uint8_t location[MAX_ROUNDS]; memcpy(location, indexer->round_start, MAX_ROUNDS);
+    for(uint_fast32_t i=0; i<SUITS; ++i) {
+        unindex_suit(configuration, i, suit_index[i], location, cards);
+    }
+
+    return true;
+}
+
+hand_indexer::hand_iterator::hand_iterator(const hand_indexer& indexer, int round, hand_index_t index)
+    : indexer_(&indexer)
+    , round_(round)
+    , index_(index)
+    , configuration_(0)
+    , configuration_end_(0)
+{
+    assert(round < indexer.get_rounds());
 
-            //for(suit_index[i]=0; nCr_groups[suit_index[i]+1+j-i-1][j-i] <= group_index; ++suit_index[i]) {}
-            group_index -= nCr_groups[suit_index[i]+j-i-1][j-i]; 
+    if (index_ < indexer_->get_size(round_)) {
+        decode_configuration();
+    }
+}
+
+void hand_indexer::hand_iterator::next()
+{
+    if (++index_ >= configuration_end_) {
+        if (index_ < indexer_->get_size(round_)) {
+            decode_configuration();
         }
+        return;
+    }
 
-        suit_index[i] = group_index; ++i;
+    /* the first suit group is the least significant digit of the index within a configuration */
+    for(uint_fast32_t i=0; i<SUITS; i=group_ends_[i]) {
+        if (++group_indices_[i] < group_sizes_[i]) {
+            decode_group(i);
+            return;
+        }
+        group_indices_[i] = 0;
+        decode_group(i);
     }
+}
+
+hand_indexer::hand_index_t hand_indexer::hand_iterator::get_index() const
+{
+    return index_;
+}
+
+const card_t * hand_indexer::hand_iterator::get_cards() const
+{
+    return cards_.data();
+}
+
+void hand_indexer::hand_iterator::decode_configuration()
+{
+    const hand_indexer_t * indexer = indexer_->indexer;
+
+    configuration_ = find_configuration(indexer, round_, index_);
+    configuration_end_ = configuration_+1 < indexer->configurations[round_]
+        ? indexer->configuration_to_offset[round_][configuration_+1] : indexer->round_size[round_];
 
+    const uint_fast32_t * configuration = indexer->configuration[round_][configuration_];
+    hand_index_t index = index_ - indexer->configuration_to_offset[round_][configuration_];
+
+    /* the cards of a suit are at fixed positions within a configuration */
     uint8_t location[MAX_ROUNDS]; memcpy(location, indexer->round_start, MAX_ROUNDS);
     for(uint_fast32_t i=0; i<SUITS; ++i) {
-        uint_fast32_t used = 0, m = 0;
+        memcpy(locations_[i].data(), location, MAX_ROUNDS);
         for(uint_fast32_t j=0; j<indexer->rounds; ++j) {
-            uint_fast32_t n              = indexer->configuration[round][configuration_idx][i]>>ROUND_SHIFT*(indexer->rounds-j-1)&ROUND_MASK;
-            uint_fast32_t round_size     = nCr_ranks[RANKS-m][n]; m += n;
-            uint_fast32_t round_idx      = suit_index[i]%round_size; suit_index[i] /= round_size;
-            uint_fast32_t shifted_cards  = index_to_rank_set[n][round_idx], rank_set = 0;
-            for(uint_fast32_t k=0; k<n; ++k) {
-                uint_fast32_t shifted_card = shifted_cards&-shifted_cards; shifted_cards ^= shifted_card;
-                uint_fast32_t card         = nth_unset[used][__builtin_ctz(shifted_card)]; rank_set |= 1<<card;
-                cards[location[j]++]       = get_card(card, i);
-            }
-            used |= rank_set;
+            location[j] += configuration[i]>>ROUND_SHIFT*(indexer->rounds-j-1)&ROUND_MASK;
         }
     }
 
-    return true;
+    for(uint_fast32_t i=0; i<SUITS;) {
+        uint_fast32_t j=i+1; for(; j<SUITS && configuration[j] == configuration[i]; ++j) {}
+
+        uint_fast32_t suit_size = indexer->configuration_to_suit_size[round_][configuration_][i];
+        group_ends_[i]          = j;
+        group_sizes_[i]         = indexer_->tables->nCr_groups[suit_size+j-i-1][j-i];
+        group_indices_[i]       = index%group_sizes_[i]; index /= group_sizes_[i];
+
+        decode_group(i);
+        i = j;
+    }
+}
+
+void hand_indexer::hand_iterator::decode_group(uint_fast32_t i)
+{
+    const hand_indexer_t * indexer = indexer_->indexer;
+    const uint_fast32_t * configuration = indexer->configuration[round_][configuration_];
+
+    hand_index_t suit_index[SUITS];
+    indexer_->unindex_group(indexer->configuration_to_suit_size[round_][configuration_][i], i, group_ends_[i],
+        group_indices_[i], suit_index);
+
+    for(uint_fast32_t k=i; k<group_ends_[i]; ++k) {
+        uint8_t location[MAX_ROUNDS]; memcpy(location, locations_[k].data(), MAX_ROUNDS);
+        indexer_->unindex_suit(configuration, k, suit_index[k], location, cards_.data());
+    }
 }
 
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 
-hand_indexer::hand_indexer(const std::vector<std::uint8_t>& cards_per_round)
+hand_indexer_tables_t::hand_indexer_tables_t()
 {
     for(uint_fast32_t i=0; i<1<<(SUITS-1); ++i) {
         for(uint_fast32_t j=1; j<SUITS; ++j) {
@@ -536,14 +709,7 @@ hand_indexer::hand_indexer(const std::vector<std::uint8_t>& cards_per_round)
         index_to_rank_set[__builtin_popcount(i)][rank_set_to_index[i]] = i;
     }
 
-    uint_fast32_t num_permutations = 1;
-    for(uint_fast32_t i=2; i<=SUITS; ++i) {
-        num_permutations *= i;
-    }
-
-    suit_permutations = reinterpret_cast<uint_fast32_t(*)[4]>(calloc(num_permutations, SUITS*sizeof(uint_fast32_t)));
-
-    for(uint_fast32_t i=0; i<num_permutations; ++i) {
+    for(uint_fast32_t i=0; i<SUIT_PERMUTATIONS; ++i) {
         for(uint_fast32_t j=0, index=i, used=0; j<SUITS; ++j) {
             uint_fast32_t suit = index%(SUITS-j); index /= SUITS-j;
             uint_fast32_t shifted_suit = nth_unset[used][suit];
@@ -551,7 +717,18 @@ hand_indexer::hand_indexer(const std::vector<std::uint8_t>& cards_per_round)
             used                   |= 1<<shifted_suit;
         }
     }
+}
 
+static const hand_indexer_tables_t& get_tables()
+{
+    // function local so that indexers constructed during static initialization can use it
+    static const hand_indexer_tables_t tables;
+    return tables;
+}
+
+hand_indexer::hand_indexer(const std::vector<std::uint8_t>& cards_per_round)
+    : tables(&get_tables())
+{
     const auto rounds = cards_per_round.size();
 
     if (rounds == 0) {
@@ -1,43 +1,131 @@
 #pragma once
 
 #include <string>
+#include <algorithm>
 #include <cstdint>
 #include <cstddef>
 #include <vector>
 #include <array>
 #include "util/card.h"
 
-struct hand_indexer_state_t;
 struct hand_indexer_t;
+struct hand_indexer_tables_t;
+
+struct hand_indexer_state_t
+{
+    uint_fast32_t suit_index[SUITS];
+    uint_fast32_t suit_multiplier[SUITS];
+    uint_fast32_t round, permutation_index, permutation_multiplier;
+    uint32_t used_ranks[SUITS];
+};
 
 class hand_indexer
 {
 public:
     typedef std::uint64_t hand_index_t;
 
+    static const unsigned int MAX_HAND_ROUNDS = 8;
+
+    // walks the canonical hands of a round in index order; only the suits whose part of the index changed are
+    // decoded again on each step so iterating is much cheaper than calling hand_unindex for every index, and
+    // iterators can start at any index so contiguous index ranges can be walked by different threads
+    class hand_iterator
+    {
+    public:
+        hand_iterator(const hand_indexer& indexer, int round, hand_index_t index);
+        void next();
+        hand_index_t get_index() const;
+        const card_t* get_cards() const;
+
+    private:
+        void decode_configuration();
+        void decode_group(uint_fast32_t first_suit);
+
+        const hand_indexer* indexer_;
+        int round_;
+        hand_index_t index_;
+        uint_fast32_t configuration_;
+        hand_index_t configuration_end_;
+        // indexed by the first suit of each group of suits with equal configurations
+        std::array<uint_fast32_t, SUITS> group_ends_;
+        std::array<hand_index_t, SUITS> group_indices_;
+        std::array<hand_index_t, SUITS> group_sizes_;
+        std::array<std::array<std::uint8_t, MAX_HAND_ROUNDS>, SUITS> locations_;
+        std::array<card_t, CARDS> cards_;
+    };
+
     hand_indexer(const std::vector<card_t>& cards_per_round);
     ~hand_indexer();
 
     hand_index_t hand_index_last(const card_t cards[]) const;
+    // indexes count hands stored back to back (all cards up to round each) into the given round
+    void hand_index_batch(int round, const card_t hands[], std::size_t count, hand_index_t indices[]) const;
     bool hand_unindex(int round, hand_index_t index, card_t cards[]) const;
+    // hands can also be indexed a round at a time; the state after a round only depends on the cards so far and
+    // on the cards per round up to it, so it can be copied to other indexers whose earlier rounds are the same
+    void hand_index_init(hand_indexer_state_t* state) const;
+    hand_index_t hand_index_next_round(const card_t cards[], hand_indexer_state_t* state) const;
     std::size_t get_size(int round) const;
     int get_rounds() const;
+    // calls f(index, cards) for every canonical hand of the round in parallel; each task walks a contiguous block
+    // of indices with a hand_iterator
+    template<class F>
+    void for_each_hand(int round, F f) const;
+    // indexes the hands of the last round made of the first Cards - 1 cards of hand and each card not among them
+    // in one batch and calls f(indices, count)
+    template<int Cards, class F>
+    void index_completions(const card_t hand[], F f) const;
 
 private:
-    static const unsigned int MAX_GROUP_INDEX = 0x100000;
-
     void tabulate_configurations(uint_fast32_t round, uint_fast32_t configuration[], void * data);
-    hand_index_t hand_index_next_round(const uint8_t cards[], hand_indexer_state_t * state) const;
     hand_index_t hand_index_all(const uint8_t cards[], hand_index_t indices[]) const;
+    void unindex_group(uint_fast32_t suit_size, uint_fast32_t first_suit, uint_fast32_t end_suit,
+        hand_index_t group_index, hand_index_t suit_index[]) const;
+    void unindex_suit(const uint_fast32_t configuration[], uint_fast32_t suit, hand_index_t suit_index,
+        uint8_t location[], card_t cards[]) const;
 
-    std::array<std::array<std::uint8_t, RANKS>, 1 << RANKS> nth_unset;
-    std::array<std::array<bool, SUITS>, 1 << (SUITS - 1)> equal;
-    std::array<std::array<std::uint32_t, RANKS + 1>, RANKS + 1> nCr_ranks;
-    std::array<std::uint32_t, 1 << RANKS> rank_set_to_index;
-    std::array<std::array<std::uint32_t, 1 << RANKS>, RANKS + 1> index_to_rank_set;
-    //std::uint32_t index_to_rank_set[RANKS][1 << RANKS];
-    std::uint_fast32_t (*suit_permutations)[SUITS];
-    std::array<std::array<hand_index_t, SUITS + 1>, MAX_GROUP_INDEX> nCr_groups;
-
+    // game-agnostic tables shared by every instance
+    const hand_indexer_tables_t* tables;
     hand_indexer_t* indexer;
 };
+
+template<class F>
+void hand_indexer::for_each_hand(const int round, F f) const
+{
+    // large enough to amortize starting an iterator, small enough to balance the threads
+    static const std::int64_t BLOCK_SIZE = 4096;
+
+    const auto size = static_cast<std::int64_t>(get_size(round));
+
+#pragma omp parallel for schedule(dynamic)
+    for (std::int64_t block = 0; block < (size + BLOCK_SIZE - 1) / BLOCK_SIZE; ++block)
+    {
+        const auto end = std::min(size, (block + 1) * BLOCK_SIZE);
+
+        for (hand_iterator it(*this, round, block * BLOCK_SIZE); static_cast<std::int64_t>(it.get_index()) < end;
+            it.next())
+        {
+            f(it.get_index(), it.get_cards());
+        }
+    }
+}
+
+template<int Cards, class F>
+void hand_indexer::index_completions(const card_t hand[], F f) const
+{
+    std::array<card_t, (CARDS - Cards + 1) * Cards> hands;
+    std::array<hand_index_t, CARDS - Cards + 1> indices;
+    std::size_t count = 0;
+
+    for (card_t card = 0; card < CARDS; ++card)
+    {
+        if (std::find(hand, hand + Cards - 1, card) != hand + Cards - 1)
+            continue;
+
+        std::copy(hand, hand + Cards - 1, &hands[count * Cards]);
+        hands[count++ * Cards + Cards - 1] = card;
+    }
+
+    hand_index_batch(get_rounds() - 1, hands.data(), count, indices.data());
+    f(static_cast<const hand_index_t*>(indices.data()), count);
+}
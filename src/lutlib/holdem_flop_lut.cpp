@@ -0,0 +1,96 @@
+#include "holdem_flop_lut.h"
+#ifdef _MSC_VER
+#pragma warning(push, 1)
+#endif
+#include <algorithm>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+#include "util/card.h"
+#include "holdem_turn_lut.h"
+
+namespace
+{
+    std::unique_ptr<hand_indexer> create()
+    {
+        std::vector<card_t> cfg;
+        cfg.push_back(2);
+        cfg.push_back(3);
+        return std::unique_ptr<hand_indexer>(new hand_indexer(cfg));
+    }
+}
+
+holdem_flop_lut::holdem_flop_lut(const holdem_turn_lut& turn_lut)
+    : indexer_(create())
+    , table_(indexer_->get_size(indexer_->get_rounds() - 1))
+{
+    const auto generated = table_.get_generated();
+    const auto& turn_indexer = turn_lut.get_indexer();
+
+    indexer_->for_each_hand(indexer_->get_rounds() - 1, [&](const index_t index, const card_t* cards)
+    {
+        turn_indexer.index_completions<6>(cards, [&](const hand_indexer::hand_index_t indices[],
+            const std::size_t count)
+        {
+            // every turn card is followed by the same number of river cards so the means over the turn cards
+            // are the means over all turn and river cards
+            double sum = 0;
+            double sum2 = 0;
+
+            for (std::size_t j = 0; j < count; ++j)
+            {
+                const auto value = turn_lut.get(indices[j]);
+                sum += value[holdem_turn_lut::EHS];
+                sum2 += value[holdem_turn_lut::EHS2];
+            }
+
+            auto& data = generated[index];
+            data[EHS] = float(sum / count);
+            data[EHS2] = float(sum2 / count);
+        });
+    });
+}
+
+holdem_flop_lut::holdem_flop_lut(const std::string& filename, const bool preload)
+    : indexer_(create())
+    , table_(filename, indexer_->get_size(indexer_->get_rounds() - 1), preload)
+{
+}
+
+void holdem_flop_lut::save(const std::string& filename, const lut_file::format_type format) const
+{
+    table_.save(filename, format);
+}
+
+holdem_flop_lut::data_type holdem_flop_lut::get(const std::array<int, 5>& cards) const
+{
+    return get(get_key(cards));
+}
+
+holdem_flop_lut::data_type holdem_flop_lut::get(const index_t index) const
+{
+    return table_.get(index);
+}
+
+holdem_flop_lut::index_t holdem_flop_lut::get_key(const std::array<int, 5>& cards) const
+{
+    std::array<card_t, 5> c;
+    std::transform(cards.begin(), cards.end(), c.begin(), [](const int card) { return static_cast<card_t>(card); });
+
+    return indexer_->hand_index_last(c.data());
+}
+
+const holdem_flop_lut::data_type* holdem_flop_lut::get_data() const
+{
+    return table_.get_data();
+}
+
+lut_file::format_type holdem_flop_lut::get_format() const
+{
+    return table_.get_format();
+}
+
+const hand_indexer& holdem_flop_lut::get_indexer() const
+{
+    return *indexer_;
+}
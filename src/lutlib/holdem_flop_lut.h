@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <memory>
+#include "hand_indexer.h"
+#include "lut_table.h"
+
+class holdem_turn_lut;
+
+// expected hand strength on the flop: the mean river equity over all turn and river cards and the mean of its
+// square
+class holdem_flop_lut
+{
+public:
+    typedef std::array<float, 2> data_type;
+    typedef hand_indexer::hand_index_t index_t;
+
+    enum
+    {
+        EHS,
+        EHS2,
+    };
+
+    // aggregates the turn LUT
+    holdem_flop_lut(const holdem_turn_lut& turn_lut);
+    // loads a LUT file, see lut_table
+    holdem_flop_lut(const std::string& filename, bool preload = false);
+    void save(const std::string& filename, lut_file::format_type format = lut_file::LUT_FLOAT) const;
+    data_type get(const std::array<int, 5>& cards) const;
+    data_type get(index_t index) const;
+    index_t get_key(const std::array<int, 5>& cards) const;
+    const data_type* get_data() const;
+    lut_file::format_type get_format() const;
+    const hand_indexer& get_indexer() const;
+
+private:
+    std::unique_ptr<hand_indexer> indexer_;
+    lut_table<float, 2> table_;
+};
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <boost/format.hpp>
 #include <cstring>
+#include <algorithm>
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -13,9 +14,13 @@
 #include "util/sort.h"
 #include "util/card.h"
 #include "util/binary_io.h"
+#include "lut_parts.h"
 
 namespace
 {
+    // opponent hands left after the hole cards and the board are removed
+    const int SHOWDOWNS = (CARDS - 7) * (CARDS - 8) / 2;
+
     std::unique_ptr<hand_indexer> create()
     {
         std::vector<card_t> cfg;
@@ -23,33 +28,92 @@ namespace
         cfg.push_back(5);
         return std::unique_ptr<hand_indexer>(new hand_indexer(cfg));
     }
+
+    // evaluates every hole card pair on the board once and derives the equity of each pair against all the others
+    // from counts over the pairs sorted by hand value; pairs sharing a card with the hand are excluded using per
+    // card counts, so the win and tie counts are exactly the ones holdem_evaluator::enumerate_river finds. Writes
+    // the river index and value of each of the BOARD_PAIRS hands
+    void create_board(const holdem_evaluator& e, const hand_indexer& indexer, const card_t board[],
+        hand_indexer::hand_index_t indices[], holdem_river_lut::data_type values[])
+    {
+        std::array<card_t, BOARD_PAIRS * 7> hands;
+        std::array<std::pair<int, int>, BOARD_PAIRS> hand_values;
+        evaluate_board_pairs(e, indexer, board, hands.data(), hand_values.data(), indices);
+
+        // pairs with a lower hand value in total and per card
+        int less = 0;
+        std::array<int, CARDS> card_less = {{}};
+
+        for (int i = 0; i < BOARD_PAIRS;)
+        {
+            int j = i + 1;
+
+            for (; j < BOARD_PAIRS && hand_values[j].first == hand_values[i].first; ++j) {}
+
+            std::array<int, CARDS> card_equal = {{}};
+
+            for (int k = i; k < j; ++k)
+            {
+                ++card_equal[hands[hand_values[k].second * 7]];
+                ++card_equal[hands[hand_values[k].second * 7 + 1]];
+            }
+
+            for (int k = i; k < j; ++k)
+            {
+                const int hand = hand_values[k].second;
+                const card_t c0 = hands[hand * 7];
+                const card_t c1 = hands[hand * 7 + 1];
+                const int wins = less - card_less[c0] - card_less[c1];
+                // the pair itself is counted in both card counts
+                const int ties = (j - i) - card_equal[c0] - card_equal[c1] + 1;
+
+                values[hand] = holdem_river_lut::data_type((wins + 0.5 * ties) / SHOWDOWNS);
+            }
+
+            less += j - i;
+
+            for (int c = 0; c < static_cast<int>(CARDS); ++c)
+                card_less[c] += card_equal[c];
+
+            i = j;
+        }
+    }
 }
 
 holdem_river_lut::holdem_river_lut()
     : indexer_(create())
+    , table_(indexer_->get_size(indexer_->get_rounds() - 1))
 {
-    data_.resize(indexer_->get_size(indexer_->get_rounds() - 1));
+    const auto generated = table_.get_generated();
 
     std::unique_ptr<holdem_evaluator> e(new holdem_evaluator);
 
+    // hands on different canonical boards never share an index, see lut_parts.h
+    const auto boards = get_canonical_board_count();
+
     const double start_time = omp_get_wtime();
     double time = start_time;
     unsigned int iteration = 0;
 
-#pragma omp parallel for
-    for (std::int64_t i = 0; i < static_cast<std::int64_t>(data_.size()); ++i)
+#pragma omp parallel for schedule(dynamic)
+    for (std::int64_t i = 0; i < boards; ++i)
     {
-        std::array<card_t, 7> cards;
-        indexer_->hand_unindex(indexer_->get_rounds() - 1, i, cards.data());
+        std::array<card_t, 5> board;
+        get_canonical_board(i, board.data());
 
-        data_[i] = holdem_river_lut::data_type(e->enumerate_river(cards[0], cards[1], cards[2], cards[3], cards[4], cards[5], cards[6]));
+        std::array<index_t, BOARD_PAIRS> indices;
+        std::array<data_type, BOARD_PAIRS> values;
+        create_board(*e, *indexer_, board.data(), indices.data(), values.data());
+
+        for (int j = 0; j < BOARD_PAIRS; ++j)
+            generated[indices[j]] = values[j];
 
 #pragma omp atomic
         ++iteration;
 
         const double t = omp_get_wtime();
 
-        if (iteration == data_.size() || (omp_get_thread_num() == 0 && t - time >= 1))
+        if (iteration == boards || (omp_get_thread_num() == 0 && t - time >= 1))
         {
             // TODO use same progress system as cfr
             const double duration = t - start_time;
@@ -57,36 +121,57 @@ holdem_river_lut::holdem_river_lut()
             const int minute = int(duration / 60 - hour * 60);
             const int second = int(duration - minute * 60 - hour * 3600);
             const int ips = int(iteration / duration);
-            std::cout << boost::format("%02d:%02d:%02d: %d/%d (%d i/s)\n") %
-                hour % minute % second % iteration % data_.size() % ips;
+            std::cout << boost::format("%02d:%02d:%02d: %d/%d boards (%d i/s)\n") %
+                hour % minute % second % iteration % boards % ips;
             time = t;
         }
     }
 }
 
-holdem_river_lut::holdem_river_lut(const std::string& filename)
+holdem_river_lut::holdem_river_lut(const std::string& filename, const bool preload)
     : indexer_(create())
+    , table_(filename, indexer_->get_size(indexer_->get_rounds() - 1), preload)
 {
-    data_.resize(indexer_->get_size(indexer_->get_rounds() - 1));
+}
 
-    auto file = binary_open(filename, "rb");
+void holdem_river_lut::create_boards(const std::int64_t first_board, const std::int64_t last_board,
+    const std::function<void(const index_t indices[], const data_type values[], std::size_t count)>& write,
+    const std::string& ranks_filename)
+{
+    const auto indexer = create();
+    std::unique_ptr<holdem_evaluator> e(new holdem_evaluator(ranks_filename));
 
-    if (!file)
-        throw std::runtime_error("bad file");
+    create_board_entries(first_board, last_board, [&](const card_t board[], index_t board_indices[], data_type values[])
+    {
+        create_board(*e, *indexer, board, board_indices, values);
+    }, BOARD_PAIRS, lut_entries_writer<data_type>(write));
+}
 
-    binary_read(*file, data_.data(), data_.size());
+holdem_river_lut::index_t holdem_river_lut::get_size()
+{
+    const auto indexer = create();
+    return indexer->get_size(indexer->get_rounds() - 1);
 }
 
-void holdem_river_lut::save(const std::string& filename) const
+void holdem_river_lut::save(const std::string& filename, const lut_file::format_type format) const
 {
-    auto file = binary_open(filename, "wb");
+    table_.save(filename, format);
+}
 
-    binary_write(*file, data_.data(), data_.size());
+void holdem_river_lut::save(const std::string& filename, const data_type* data, const std::size_t size,
+    const lut_file::format_type format)
+{
+    table_type::save(filename, data, size, format);
 }
 
-const holdem_river_lut::data_type& holdem_river_lut::get(const std::array<int, 7>& cards) const
+holdem_river_lut::data_type holdem_river_lut::get(const std::array<int, 7>& cards) const
 {
-    return data_[get_key(cards)];
+    return get(get_key(cards));
+}
+
+holdem_river_lut::data_type holdem_river_lut::get(const index_t index) const
+{
+    return table_.get(index);
 }
 
 hand_indexer::hand_index_t holdem_river_lut::get_key(const std::array<int, 7>& cards) const
@@ -102,3 +187,13 @@ hand_indexer::hand_index_t holdem_river_lut::get_key(const std::array<int, 7>& c
 
     return indexer_->hand_index_last(c.data());
 }
+
+const holdem_river_lut::data_type* holdem_river_lut::get_data() const
+{
+    return table_.get_data();
+}
+
+const hand_indexer& holdem_river_lut::get_indexer() const
+{
+    return *indexer_;
+}
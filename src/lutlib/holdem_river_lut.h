@@ -2,7 +2,9 @@
 
 #include <vector>
 #include <memory>
+#include <functional>
 #include "hand_indexer.h"
+#include "lut_table.h"
 
 class holdem_river_lut
 {
@@ -10,13 +12,31 @@ public:
     typedef float data_type;
     typedef hand_indexer::hand_index_t index_t;
 
+    // equities are (wins + ties / 2) / 990 so fixed-point codes of 2 * wins + ties are exact
+    static const int CODE_SCALE = 2 * 990;
+
     holdem_river_lut();
-    holdem_river_lut(const std::string& filename);
-    void save(const std::string& filename) const;
-    const data_type& get(const std::array<int, 7>& cards) const;
+    // loads a LUT file, see lut_table
+    holdem_river_lut(const std::string& filename, bool preload = false);
+    void save(const std::string& filename, lut_file::format_type format = lut_file::LUT_FLOAT) const;
+    data_type get(const std::array<int, 7>& cards) const;
+    data_type get(index_t index) const;
     index_t get_key(const std::array<int, 7>& cards) const;
+    const data_type* get_data() const;
+    const hand_indexer& get_indexer() const;
+
+    // generates the entries of all canonical river hands on canonical boards [first_board, last_board), see
+    // lut_parts.h; every index is written once
+    static void create_boards(std::int64_t first_board, std::int64_t last_board,
+        const std::function<void(const index_t indices[], const data_type values[], std::size_t count)>& write,
+        const std::string& ranks_filename = "ranks.dat");
+    static index_t get_size();
+    static void save(const std::string& filename, const data_type* data, std::size_t size,
+        lut_file::format_type format);
 
 private:
-    std::vector<data_type> data_;
+    typedef lut_table<float, 1, CODE_SCALE> table_type;
+
     std::unique_ptr<hand_indexer> indexer_;
+    table_type table_;
 };
@@ -5,6 +5,7 @@
 #include <omp.h>
 #include <iostream>
 #include <numeric>
+#include <algorithm>
 #include <boost/format.hpp>
 #include <boost/assign.hpp>
 #ifdef _MSC_VER
@@ -14,9 +15,14 @@
 #include "util/sort.h"
 #include "util/card.h"
 #include "util/binary_io.h"
+#include "lut_parts.h"
 
 namespace
 {
+    static const int CLUSTERS = std::tuple_size<holdem_river_ochs_lut::data_type>::value;
+
+    typedef std::array<std::array<std::uint8_t, CARDS>, CARDS> pair_clusters_t;
+
     std::unique_ptr<hand_indexer> create()
     {
         std::vector<card_t> cfg;
@@ -24,100 +30,196 @@ namespace
         cfg.push_back(5);
         return std::unique_ptr<hand_indexer>(new hand_indexer(cfg));
     }
-}
 
-holdem_river_ochs_lut::holdem_river_ochs_lut()
-    : indexer_(create())
-{
-    data_.resize(indexer_->get_size(indexer_->get_rounds() - 1));
-
-    std::cout << "create_preflop_buckets start\n";
-
-    std::array<int, 169> preflop_clusters =
-    {{
-        4, 1, 6, 1, 1, 6, 1, 1, 1, 6, 1, 1, 1,
-        1, 7, 1, 1, 1, 2, 3, 7, 1, 1, 2, 2, 3,
-        3, 8, 2, 2, 2, 2, 3, 3, 3, 8, 2, 2, 2,
-        2, 3, 3, 3, 5, 8, 2, 2, 4, 4, 4, 4, 5,
-        5, 5, 8, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5,
-        8, 4, 4, 4, 6, 6, 6, 6, 6, 7, 7, 7, 8,
-        6, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 8,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 1, 1, 2,
-        3, 3, 2, 2, 2, 3, 3, 3, 2, 2, 2, 3, 3,
-        3, 3, 2, 3, 3, 3, 3, 5, 5, 5, 4, 4, 4,
-        4, 4, 5, 5, 5, 5, 4, 4, 4, 4, 5, 5, 5,
-        5, 7, 7, 4, 6, 6, 6, 6, 6, 6, 7, 7, 7,
-        7, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7
-    }};
-
-    std::vector<card_t> cfg;
-    cfg.push_back(2);
-    std::unique_ptr<hand_indexer> preflop_indexer(new hand_indexer(cfg));
+    // opponent clusters of all hole card pairs, 0-based as the preflop cluster numbers are 1-based
+    pair_clusters_t get_pair_clusters()
+    {
+        static const std::array<int, 169> preflop_clusters =
+        {{
+            4, 1, 6, 1, 1, 6, 1, 1, 1, 6, 1, 1, 1,
+            1, 7, 1, 1, 1, 2, 3, 7, 1, 1, 2, 2, 3,
+            3, 8, 2, 2, 2, 2, 3, 3, 3, 8, 2, 2, 2,
+            2, 3, 3, 3, 5, 8, 2, 2, 4, 4, 4, 4, 5,
+            5, 5, 8, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5,
+            8, 4, 4, 4, 6, 6, 6, 6, 6, 7, 7, 7, 8,
+            6, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 8,
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 1, 1, 2,
+            3, 3, 2, 2, 2, 3, 3, 3, 2, 2, 2, 3, 3,
+            3, 3, 2, 3, 3, 3, 3, 5, 5, 5, 4, 4, 4,
+            4, 4, 5, 5, 5, 5, 4, 4, 4, 4, 5, 5, 5,
+            5, 7, 7, 4, 6, 6, 6, 6, 6, 6, 7, 7, 7,
+            7, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7
+        }};
 
-    std::unique_ptr<holdem_evaluator> eval(new holdem_evaluator);
+        std::vector<card_t> cfg;
+        cfg.push_back(2);
+        std::unique_ptr<hand_indexer> preflop_indexer(new hand_indexer(cfg));
+
+        pair_clusters_t pair_clusters = {{}};
+        std::array<card_t, 2> pair;
+
+        for (pair[0] = 0; pair[0] < CARDS; ++pair[0])
+        {
+            for (pair[1] = pair[0] + 1; pair[1] < CARDS; ++pair[1])
+                pair_clusters[pair[0]][pair[1]] = std::uint8_t(preflop_clusters[preflop_indexer->hand_index_last(pair.data())] - 1);
+        }
+
+        return pair_clusters;
+    }
 
-#pragma omp parallel for
-    for (std::int64_t i = 0; i < static_cast<std::int64_t>(data_.size()); ++i)
+    // evaluates every hole card pair on the board once and sweeps the pairs in hand value order, keeping the
+    // counts of lower and equal valued pairs per opponent cluster; pairs sharing a card with the hand are excluded
+    // using per card counts. The accumulated float sums are small integers or halves and exact in any order, so
+    // the results match enumerating the opponents of each hand one by one. Writes the river index and values of
+    // each of the BOARD_PAIRS hands
+    void create_board(const holdem_evaluator& e, const hand_indexer& indexer, const pair_clusters_t& pair_clusters,
+        const card_t board[], hand_indexer::hand_index_t indices[], holdem_river_ochs_lut::data_type values[])
     {
-        std::array<card_t, 7> cards;
-        indexer_->hand_unindex(indexer_->get_rounds() - 1, i, cards.data());
+        std::array<card_t, BOARD_PAIRS * 7> hands;
+        std::array<std::pair<int, int>, BOARD_PAIRS> hand_values;
+        evaluate_board_pairs(e, indexer, board, hands.data(), hand_values.data(), indices);
 
-        data_type sum = {};
-        std::array<card_t, 2> opp_cards;
+        // pairs per cluster in total, with a lower value and with the current value, and the same per card
+        std::array<int, CLUSTERS> total = {{}}, less = {{}}, equal = {{}};
+        std::array<std::array<int, CARDS>, CLUSTERS> card_total = {{}}, card_less = {{}}, card_equal = {{}};
 
-        for (card_t c0 = 0; c0 < 51; ++c0)
+        for (int i = 0; i < BOARD_PAIRS; ++i)
         {
-            if (c0 == cards[0] || c0 == cards[1] || c0 == cards[2] || c0 == cards[3] || c0 == cards[4] || c0 == cards[5] || c0 == cards[6])
-                continue;
-
-            opp_cards[0] = c0;
+            const int cluster = pair_clusters[hands[i * 7]][hands[i * 7 + 1]];
+            ++total[cluster];
+            ++card_total[cluster][hands[i * 7]];
+            ++card_total[cluster][hands[i * 7 + 1]];
+        }
 
-            for (card_t c1 = c0 + 1; c1 < 52; ++c1)
-            {
-                if (c1 == cards[0] || c1 == cards[1] || c1 == cards[2] || c1 == cards[3] || c1 == cards[4] || c1 == cards[5] || c1 == cards[6])
-                    continue;
+        for (int i = 0; i < BOARD_PAIRS;)
+        {
+            int j = i + 1;
 
-                opp_cards[1] = c1;
+            for (; j < BOARD_PAIRS && hand_values[j].first == hand_values[i].first; ++j) {}
 
-                const auto v0 = eval->get_hand_value(cards[0], cards[1], cards[2], cards[3], cards[4], cards[5], cards[6]);
-                const auto v1 = eval->get_hand_value(opp_cards[0], opp_cards[1], cards[2], cards[3], cards[4], cards[5], cards[6]);
+            for (int k = i; k < j; ++k)
+            {
+                const card_t* cards = &hands[hand_values[k].second * 7];
+                const int cluster = pair_clusters[cards[0]][cards[1]];
+                ++equal[cluster];
+                ++card_equal[cluster][cards[0]];
+                ++card_equal[cluster][cards[1]];
+            }
 
-                const auto preflop_idx = preflop_indexer->hand_index_last(opp_cards.data());
-                const auto preflop_cluster = preflop_clusters[preflop_idx] - 1; // subtract one as the cluster numbers are 1-based
-                data_[i][preflop_cluster] += (v0 > v1) ? 1 : ((v0 == v1) ? 0.5f : 0.0f);
+            for (int k = i; k < j; ++k)
+            {
+                const card_t* cards = &hands[hand_values[k].second * 7];
+                const card_t c0 = cards[0];
+                const card_t c1 = cards[1];
+                const int own_cluster = pair_clusters[c0][c1];
+                auto& p = values[hand_values[k].second];
+
+                for (int c = 0; c < CLUSTERS; ++c)
+                {
+                    // the pair itself is counted in both card counts of its own cluster
+                    const int self = c == own_cluster ? 1 : 0;
+                    const int wins = less[c] - card_less[c][c0] - card_less[c][c1];
+                    const int ties = equal[c] - card_equal[c][c0] - card_equal[c][c1] + self;
+                    const int showdowns = total[c] - card_total[c][c0] - card_total[c][c1] + self;
+                    p[c] = float(wins + 0.5f * ties) / float(showdowns);
+                }
+            }
 
-                ++sum[preflop_cluster];
+            for (int k = i; k < j; ++k)
+            {
+                const card_t* cards = &hands[hand_values[k].second * 7];
+                const int cluster = pair_clusters[cards[0]][cards[1]];
+                --equal[cluster];
+                --card_equal[cluster][cards[0]];
+                --card_equal[cluster][cards[1]];
+                ++less[cluster];
+                ++card_less[cluster][cards[0]];
+                ++card_less[cluster][cards[1]];
             }
+
+            i = j;
         }
+    }
+}
 
-        for (std::size_t j = 0; j < data_[i].size(); ++j)
-            data_[i][j] /= sum[j];
+holdem_river_ochs_lut::holdem_river_ochs_lut()
+    : indexer_(create())
+    , table_(indexer_->get_size(indexer_->get_rounds() - 1))
+{
+    const auto generated = table_.get_generated();
+
+    std::unique_ptr<holdem_evaluator> eval(new holdem_evaluator);
+    const auto pair_clusters = get_pair_clusters();
+
+    // hands on different canonical boards never share an index, see lut_parts.h
+    const auto boards = get_canonical_board_count();
+
+#pragma omp parallel for schedule(dynamic)
+    for (std::int64_t i = 0; i < boards; ++i)
+    {
+        std::array<card_t, 5> board;
+        get_canonical_board(i, board.data());
+
+        std::array<index_t, BOARD_PAIRS> indices;
+        std::array<data_type, BOARD_PAIRS> values;
+        create_board(*eval, *indexer_, pair_clusters, board.data(), indices.data(), values.data());
+
+        for (int j = 0; j < BOARD_PAIRS; ++j)
+            generated[indices[j]] = values[j];
     }
 }
 
-holdem_river_ochs_lut::holdem_river_ochs_lut(const std::string& filename)
+holdem_river_ochs_lut::holdem_river_ochs_lut(const std::string& filename, const bool preload)
     : indexer_(create())
+    , table_(filename, indexer_->get_size(indexer_->get_rounds() - 1), preload)
 {
-    data_.resize(indexer_->get_size(indexer_->get_rounds() - 1));
+}
 
-    auto file = binary_open(filename, "rb");
+void holdem_river_ochs_lut::create_boards(const std::int64_t first_board, const std::int64_t last_board,
+    const std::function<void(const index_t indices[], const data_type values[], std::size_t count)>& write,
+    const std::string& ranks_filename)
+{
+    const auto indexer = create();
+    std::unique_ptr<holdem_evaluator> eval(new holdem_evaluator(ranks_filename));
+    const auto pair_clusters = get_pair_clusters();
+
+    create_board_entries(first_board, last_board, [&](const card_t board[], index_t board_indices[], data_type values[])
+    {
+        create_board(*eval, *indexer, pair_clusters, board, board_indices, values);
+    }, BOARD_PAIRS, lut_entries_writer<data_type>(write));
+}
+
+int holdem_river_ochs_lut::get_pair_cluster(const card_t c0, const card_t c1)
+{
+    static const auto pair_clusters = get_pair_clusters();
+    return pair_clusters[c0][c1];
+}
 
-    if (!file)
-        throw std::runtime_error("bad file");
+holdem_river_ochs_lut::index_t holdem_river_ochs_lut::get_size()
+{
+    const auto indexer = create();
+    return indexer->get_size(indexer->get_rounds() - 1);
+}
 
-    binary_read(*file, data_.data(), data_.size());
+void holdem_river_ochs_lut::save(const std::string& filename, const lut_file::format_type format) const
+{
+    table_.save(filename, format);
 }
 
-void holdem_river_ochs_lut::save(const std::string& filename) const
+void holdem_river_ochs_lut::save(const std::string& filename, const data_type* data, const std::size_t size,
+    const lut_file::format_type format)
 {
-    auto file = binary_open(filename, "wb");
+    table_type::save(filename, data, size, format);
+}
 
-    binary_write(*file, data_.data(), data_.size());
+holdem_river_ochs_lut::data_type holdem_river_ochs_lut::get_data(const std::array<int, 7>& cards) const
+{
+    return get_data(get_key(cards));
 }
 
-const holdem_river_ochs_lut::data_type& holdem_river_ochs_lut::get_data(const std::array<int, 7>& cards) const
+holdem_river_ochs_lut::data_type holdem_river_ochs_lut::get_data(const index_t index) const
 {
-    return data_[get_key(cards)];
+    return table_.get(index);
 }
 
 holdem_river_ochs_lut::index_t holdem_river_ochs_lut::get_key(const std::array<int, 7>& cards) const
@@ -134,7 +236,7 @@ holdem_river_ochs_lut::index_t holdem_river_ochs_lut::get_key(const std::array<i
     return indexer_->hand_index_last(c.data());
 }
 
-const std::vector<holdem_river_ochs_lut::data_type>& holdem_river_ochs_lut::get_data() const
+const holdem_river_ochs_lut::data_type* holdem_river_ochs_lut::get_data() const
 {
-    return data_;
+    return table_.get_data();
 }
@@ -2,7 +2,9 @@
 
 #include <vector>
 #include <memory>
+#include <functional>
 #include "hand_indexer.h"
+#include "lut_table.h"
 
 class holdem_river_ochs_lut
 {
@@ -11,13 +13,30 @@ public:
     typedef hand_indexer::hand_index_t index_t;
 
     holdem_river_ochs_lut();
-    holdem_river_ochs_lut(const std::string& filename);
-    void save(const std::string& filename) const;
-    const data_type& get_data(const std::array<int, 7>& cards) const;
-    const std::vector<data_type>& get_data() const;
+    // loads a LUT file, see lut_table
+    holdem_river_ochs_lut(const std::string& filename, bool preload = false);
+    // the win rates against each cluster have different denominators so quantized formats round them to
+    // multiples of 1 / lut_file::UNIT_SCALE; a cluster without any opponent hands would be NaN and is rejected
+    void save(const std::string& filename, lut_file::format_type format = lut_file::LUT_FLOAT) const;
+    data_type get_data(const std::array<int, 7>& cards) const;
+    data_type get_data(index_t index) const;
+    const data_type* get_data() const;
     index_t get_key(const std::array<int, 7>& cards) const;
 
+    // generates the entries of all canonical river hands on canonical boards [first_board, last_board), see
+    // lut_parts.h; every index is written once
+    static void create_boards(std::int64_t first_board, std::int64_t last_board,
+        const std::function<void(const index_t indices[], const data_type values[], std::size_t count)>& write,
+        const std::string& ranks_filename = "ranks.dat");
+    // 0-based opponent cluster of the hole cards c0 < c1
+    static int get_pair_cluster(card_t c0, card_t c1);
+    static index_t get_size();
+    static void save(const std::string& filename, const data_type* data, std::size_t size,
+        lut_file::format_type format);
+
 private:
-    std::vector<data_type> data_;
+    typedef lut_table<float, 8> table_type;
+
     std::unique_ptr<hand_indexer> indexer_;
+    table_type table_;
 };
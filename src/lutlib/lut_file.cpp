@@ -0,0 +1,332 @@
+#include "lut_file.h"
+#ifdef _MSC_VER
+#pragma warning(push, 1)
+#endif
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+#include "util/binary_io.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static_assert(sizeof(lut_file::header_type) == 32, "LUT file header layout changed");
+
+const std::uint64_t lut_file::HEADER_MAGIC;
+const std::uint32_t lut_file::HEADER_VERSION;
+const std::size_t lut_file::PACKED_BLOCK_SIZE;
+const int lut_file::UNIT_SCALE;
+
+namespace
+{
+    // bit extraction reads 4 bytes at a time
+    const std::size_t PACKED_PADDING = 4;
+
+    int get_bit_width(const unsigned int value)
+    {
+        int bits = 0;
+
+        while (value >> bits)
+            ++bits;
+
+        return bits;
+    }
+
+    // per dimension minimum and bit width of the codes of a block
+    void get_block_ranges(const std::uint16_t* codes, const std::size_t count, const int dimensions,
+        const std::size_t block, std::uint16_t bases[], std::uint8_t bits[])
+    {
+        const auto first = block * lut_file::PACKED_BLOCK_SIZE;
+        const auto last = std::min(count, first + lut_file::PACKED_BLOCK_SIZE);
+
+        for (int d = 0; d < dimensions; ++d)
+        {
+            std::uint16_t min = 0xffff;
+            std::uint16_t max = 0;
+
+            for (auto i = first; i < last; ++i)
+            {
+                min = std::min(min, codes[i * dimensions + d]);
+                max = std::max(max, codes[i * dimensions + d]);
+            }
+
+            bases[d] = min;
+            bits[d] = static_cast<std::uint8_t>(get_bit_width(max - min));
+        }
+    }
+
+    std::size_t get_block_size(const int dimensions, const std::uint8_t bits[])
+    {
+        std::size_t size = dimensions * (sizeof(std::uint16_t) + sizeof(std::uint8_t));
+
+        for (int d = 0; d < dimensions; ++d)
+            size += lut_file::PACKED_BLOCK_SIZE * bits[d] / 8;
+
+        return size;
+    }
+}
+
+lut_file::lut_file(const std::string& filename, const std::size_t count, const int dimensions, const bool preload)
+    : format_(LUT_FLOAT)
+    , count_(count)
+    , dimensions_(dimensions)
+    , data_(nullptr)
+{
+    if (dimensions <= 0 || dimensions > MAX_DIMENSIONS)
+        throw std::runtime_error("Invalid LUT dimensions");
+
+    try
+    {
+        file_.open(filename);
+    }
+    catch (const std::exception& e)
+    {
+        throw std::runtime_error("Unable to open LUT file " + filename + ": " + e.what());
+    }
+
+    if (!file_.is_open())
+        throw std::runtime_error("Unable to open LUT file " + filename);
+
+    const auto size = file_.size();
+    header_type header;
+
+    if (size >= sizeof(header) && (std::memcpy(&header, file_.data(), sizeof(header)), header.magic == HEADER_MAGIC))
+    {
+        if (header.version != HEADER_VERSION)
+            throw std::runtime_error("Unsupported LUT file version " + filename);
+
+        if (header.count != count || header.dimensions != static_cast<std::uint32_t>(dimensions))
+            throw std::runtime_error("LUT file doesn't match the table " + filename);
+
+        format_ = static_cast<format_type>(header.format);
+        data_ = file_.data() + sizeof(header);
+
+        if (format_ == LUT_UINT16)
+        {
+            if (size != sizeof(header) + count * dimensions * sizeof(std::uint16_t))
+                throw std::runtime_error("Invalid LUT file size " + filename);
+        }
+        else if (format_ == LUT_PACKED)
+        {
+            const auto blocks = (count + PACKED_BLOCK_SIZE - 1) / PACKED_BLOCK_SIZE;
+            std::uint64_t end = 0;
+
+            if (size >= sizeof(header) + (blocks + 1) * sizeof(std::uint64_t))
+                std::memcpy(&end, data_ + blocks * sizeof(std::uint64_t), sizeof(end));
+
+            if (size != sizeof(header) + (blocks + 1) * sizeof(std::uint64_t) + end + PACKED_PADDING)
+                throw std::runtime_error("Invalid LUT file size " + filename);
+        }
+        else
+        {
+            throw std::runtime_error("Unknown LUT format " + filename);
+        }
+    }
+    else
+    {
+        if (size != count * dimensions * sizeof(float))
+            throw std::runtime_error("Invalid LUT file size " + filename);
+
+        data_ = file_.data();
+    }
+
+#ifdef __linux__
+    // the advice is best effort
+    madvise(const_cast<char*>(file_.data()), size, preload ? MADV_WILLNEED : MADV_RANDOM);
+#else
+    (void)preload;
+#endif
+}
+
+lut_file::format_type lut_file::get_format() const
+{
+    return format_;
+}
+
+const float* lut_file::get_floats() const
+{
+    return format_ == LUT_FLOAT ? reinterpret_cast<const float*>(data_) : nullptr;
+}
+
+void lut_file::get_codes(const std::size_t index, std::uint16_t codes[]) const
+{
+    assert(index < count_);
+
+    if (format_ == LUT_UINT16)
+    {
+        std::memcpy(codes, data_ + index * dimensions_ * sizeof(std::uint16_t), dimensions_ * sizeof(std::uint16_t));
+        return;
+    }
+
+    assert(format_ == LUT_PACKED);
+
+    const auto blocks = (count_ + PACKED_BLOCK_SIZE - 1) / PACKED_BLOCK_SIZE;
+    const auto block = index / PACKED_BLOCK_SIZE;
+    const auto position = index % PACKED_BLOCK_SIZE;
+
+    std::uint64_t offset;
+    std::memcpy(&offset, data_ + block * sizeof(std::uint64_t), sizeof(offset));
+
+    // [bases][bits][bit packed codes of each dimension]
+    const char* p = data_ + (blocks + 1) * sizeof(std::uint64_t) + offset;
+    const char* packed = p + dimensions_ * (sizeof(std::uint16_t) + sizeof(std::uint8_t));
+
+    for (int d = 0; d < dimensions_; ++d)
+    {
+        std::uint16_t base;
+        std::memcpy(&base, p + d * sizeof(std::uint16_t), sizeof(base));
+        const auto bits = static_cast<std::uint8_t>(p[dimensions_ * sizeof(std::uint16_t) + d]);
+
+        const auto bit = position * bits;
+        std::uint32_t word;
+        std::memcpy(&word, packed + bit / 8, sizeof(word));
+
+        codes[d] = static_cast<std::uint16_t>(base + ((word >> (bit % 8)) & ((1u << bits) - 1)));
+        packed += PACKED_BLOCK_SIZE * bits / 8;
+    }
+}
+
+void lut_file::write_floats(const std::string& filename, const float* values, const std::size_t count,
+    const int dimensions)
+{
+    auto file = binary_open(filename, "wb");
+
+    if (!file)
+        throw std::runtime_error("Unable to create LUT file " + filename);
+
+    binary_write(*file, values, count * dimensions);
+
+    if (std::fflush(file.get()) != 0)
+        throw std::runtime_error("Unable to write LUT file " + filename);
+}
+
+void lut_file::write_codes(const std::string& filename, const format_type format, const std::uint16_t* codes,
+    const std::size_t count, const int dimensions)
+{
+    if (format != LUT_UINT16 && format != LUT_PACKED)
+        throw std::runtime_error("Invalid LUT code format");
+
+    if (dimensions <= 0 || dimensions > MAX_DIMENSIONS)
+        throw std::runtime_error("Invalid LUT dimensions");
+
+    auto file = binary_open(filename, "wb");
+
+    if (!file)
+        throw std::runtime_error("Unable to create LUT file " + filename);
+
+    header_type header;
+    std::memset(&header, 0, sizeof(header));
+
+    header.magic = HEADER_MAGIC;
+    header.version = HEADER_VERSION;
+    header.format = format;
+    header.count = count;
+    header.dimensions = dimensions;
+
+    binary_write(*file, header);
+
+    if (format == LUT_UINT16)
+    {
+        binary_write(*file, codes, count * dimensions);
+    }
+    else
+    {
+        write_packed(*file, codes, count, dimensions);
+    }
+
+    if (std::fflush(file.get()) != 0)
+        throw std::runtime_error("Unable to write LUT file " + filename);
+}
+
+void lut_file::write_units(const std::string& filename, const format_type format, const float* values,
+    const std::size_t count, const int dimensions)
+{
+    std::vector<std::uint16_t> codes(count * dimensions);
+    bool valid = true;
+
+#pragma omp parallel for reduction(&&:valid)
+    for (std::int64_t i = 0; i < static_cast<std::int64_t>(codes.size()); ++i)
+    {
+        // also rejects NaN
+        valid = valid && values[i] >= 0 && values[i] <= 1;
+        codes[i] = valid ? static_cast<std::uint16_t>(std::lround(values[i] * UNIT_SCALE)) : 0;
+    }
+
+    if (!valid)
+        throw std::runtime_error("LUT values are not in [0, 1]");
+
+    write_codes(filename, format, codes.data(), count, dimensions);
+}
+
+void lut_file::write_packed(FILE& file, const std::uint16_t* codes, const std::size_t count, const int dimensions)
+{
+    const auto blocks = (count + PACKED_BLOCK_SIZE - 1) / PACKED_BLOCK_SIZE;
+    std::array<std::uint16_t, MAX_DIMENSIONS> bases;
+    std::array<std::uint8_t, MAX_DIMENSIONS> bits;
+
+    // the offset table has an extra entry for the end of the last block
+    std::vector<std::uint64_t> offsets(blocks + 1);
+
+    for (std::size_t block = 0; block < blocks; ++block)
+    {
+        get_block_ranges(codes, count, dimensions, block, bases.data(), bits.data());
+        offsets[block + 1] = offsets[block] + get_block_size(dimensions, bits.data());
+    }
+
+    binary_write(file, offsets.data(), offsets.size());
+
+    std::vector<char> buffer;
+
+    for (std::size_t block = 0; block < blocks; ++block)
+    {
+        get_block_ranges(codes, count, dimensions, block, bases.data(), bits.data());
+
+        buffer.assign(get_block_size(dimensions, bits.data()), 0);
+        std::memcpy(buffer.data(), bases.data(), dimensions * sizeof(std::uint16_t));
+        std::memcpy(buffer.data() + dimensions * sizeof(std::uint16_t), bits.data(), dimensions);
+
+        auto packed = reinterpret_cast<unsigned char*>(buffer.data()) + dimensions * (sizeof(std::uint16_t)
+            + sizeof(std::uint8_t));
+
+        for (int d = 0; d < dimensions; ++d)
+        {
+            // entries past the end of a partial last block are stored as the base
+            for (std::size_t i = 0; i < PACKED_BLOCK_SIZE && block * PACKED_BLOCK_SIZE + i < count; ++i)
+            {
+                const unsigned int value = codes[(block * PACKED_BLOCK_SIZE + i) * dimensions + d] - bases[d];
+                const auto bit = i * bits[d];
+
+                for (int b = 0; b < bits[d]; ++b)
+                {
+                    if (value >> b & 1)
+                        packed[(bit + b) / 8] |= static_cast<unsigned char>(1 << ((bit + b) % 8));
+                }
+            }
+
+            packed += PACKED_BLOCK_SIZE * bits[d] / 8;
+        }
+
+        binary_write(file, buffer.data(), buffer.size());
+    }
+
+    const std::array<char, PACKED_PADDING> padding = {{}};
+    binary_write(file, padding.data(), padding.size());
+}
+
+lut_file::format_type lut_file::parse_format(const std::string& name)
+{
+    if (name == "float")
+        return LUT_FLOAT;
+    else if (name == "uint16")
+        return LUT_UINT16;
+    else if (name == "packed")
+        return LUT_PACKED;
+    else
+        throw std::runtime_error("Unknown LUT format: " + name);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+// River LUT files store count entries of dimensions values each, either as
+//   LUT_FLOAT:  raw floats without a header as written by older versions
+//   LUT_UINT16: [lut_file_header][codes...] with one fixed-point uint16 code per value
+//   LUT_PACKED: [lut_file_header][block offsets...][blocks...] with the codes of every PACKED_BLOCK_SIZE entries
+//               stored relative to the per dimension minimum of the block in as few bits as needed, so single
+//               entries can still be decoded without touching the rest of the file
+// How values map to codes is up to each LUT.
+class lut_file
+{
+public:
+    enum format_type
+    {
+        LUT_FLOAT,
+        LUT_UINT16,
+        LUT_PACKED,
+    };
+
+    struct header_type
+    {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t format;
+        std::uint64_t count;
+        std::uint32_t dimensions;
+        std::uint32_t reserved;
+    };
+
+    static const std::uint64_t HEADER_MAGIC = 0x54554c534144494dull; // "MIDASLUT"
+    static const std::uint32_t HEADER_VERSION = 1;
+    static const std::size_t PACKED_BLOCK_SIZE = 64;
+    static const int MAX_DIMENSIONS = 8;
+    // scale of codes written by write_units
+    static const int UNIT_SCALE = 0xffff;
+
+    // maps the file read-only so that concurrent processes share one page cache copy of it instead of each reading
+    // the file into private memory. Lookups are random so readahead is disabled unless preload is set, which asks
+    // the kernel to read the whole file in the background for callers that touch most of the table
+    lut_file(const std::string& filename, std::size_t count, int dimensions, bool preload);
+    format_type get_format() const;
+    // float values of all entries, LUT_FLOAT only
+    const float* get_floats() const;
+    // codes of one entry, LUT_UINT16 and LUT_PACKED only
+    void get_codes(std::size_t index, std::uint16_t codes[]) const;
+
+    static void write_floats(const std::string& filename, const float* values, std::size_t count, int dimensions);
+    static void write_codes(const std::string& filename, format_type format, const std::uint16_t* codes,
+        std::size_t count, int dimensions);
+    // writes values in [0, 1] as codes rounded to multiples of 1 / UNIT_SCALE, see lut_table
+    static void write_units(const std::string& filename, format_type format, const float* values,
+        std::size_t count, int dimensions);
+    static format_type parse_format(const std::string& name);
+
+private:
+    static void write_packed(FILE& file, const std::uint16_t* codes, std::size_t count, int dimensions);
+
+    boost::iostreams::mapped_file_source file_;
+    format_type format_;
+    std::size_t count_;
+    int dimensions_;
+    const char* data_;
+};
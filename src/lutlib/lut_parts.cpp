@@ -0,0 +1,168 @@
+#include "lut_parts.h"
+#ifdef _MSC_VER
+#pragma warning(push, 1)
+#endif
+#include <fstream>
+#include <cassert>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+#include "evallib/holdem_evaluator.h"
+
+namespace
+{
+    const hand_indexer& get_board_indexer()
+    {
+        static const hand_indexer indexer(std::vector<card_t>(1, 5));
+        return indexer;
+    }
+
+    void write_manifest(const std::string& filename, const lut_manifest& manifest)
+    {
+        std::ofstream file(filename);
+
+        if (!file)
+            throw std::runtime_error("Unable to create LUT manifest");
+
+        file << "lut " << manifest.lut << "\n";
+        file << "boards " << manifest.boards << "\n";
+        file << "parts " << manifest.parts << "\n";
+
+        if (!file)
+            throw std::runtime_error("Unable to write LUT manifest");
+    }
+}
+
+std::int64_t get_canonical_board_count()
+{
+    return static_cast<std::int64_t>(get_board_indexer().get_size(0));
+}
+
+void get_canonical_board(const std::int64_t board_index, card_t board[])
+{
+    get_board_indexer().hand_unindex(0, static_cast<hand_indexer::hand_index_t>(board_index), board);
+}
+
+void evaluate_board_pairs(const holdem_evaluator& e, const hand_indexer& indexer, const card_t board[],
+    card_t hands[], std::pair<int, int> hand_values[], hand_indexer::hand_index_t indices[])
+{
+    int count = 0;
+
+    for (card_t c0 = 0; c0 < CARDS; ++c0)
+    {
+        if (std::find(board, board + 5, c0) != board + 5)
+            continue;
+
+        for (card_t c1 = c0 + 1; c1 < CARDS; ++c1)
+        {
+            if (std::find(board, board + 5, c1) != board + 5)
+                continue;
+
+            card_t* cards = &hands[count * 7];
+            cards[0] = c0;
+            cards[1] = c1;
+            std::copy(board, board + 5, cards + 2);
+            hand_values[count] = std::make_pair(e.get_hand_value(c0, c1, board[0], board[1], board[2], board[3], board[4]), count);
+            ++count;
+        }
+    }
+
+    assert(count == BOARD_PAIRS);
+
+    indexer.hand_index_batch(indexer.get_rounds() - 1, hands, BOARD_PAIRS, indices);
+
+    std::sort(hand_values, hand_values + BOARD_PAIRS);
+}
+
+lut_manifest open_lut_manifest(const std::string& filename, const std::string& lut, const int parts)
+{
+    if (parts < 0)
+        throw std::runtime_error("Invalid LUT part count");
+
+    if (std::ifstream(filename + ".manifest"))
+    {
+        const auto manifest = read_lut_manifest(filename);
+
+        if (manifest.lut != lut || manifest.boards != get_canonical_board_count()
+            || (parts != 0 && manifest.parts != parts))
+        {
+            throw std::runtime_error("LUT manifest doesn't match the requested build");
+        }
+
+        return manifest;
+    }
+
+    if (parts == 0)
+        throw std::runtime_error("LUT part count is required for a new build");
+
+    lut_manifest manifest;
+    manifest.lut = lut;
+    manifest.boards = get_canonical_board_count();
+    manifest.parts = static_cast<int>(std::min<std::int64_t>(parts, manifest.boards));
+    write_manifest(filename + ".manifest", manifest);
+
+    return manifest;
+}
+
+lut_manifest read_lut_manifest(const std::string& filename)
+{
+    std::ifstream file(filename + ".manifest");
+
+    if (!file)
+        throw std::runtime_error("Unable to open LUT manifest");
+
+    lut_manifest manifest;
+    std::string key;
+
+    if (!(file >> key >> manifest.lut) || key != "lut"
+        || !(file >> key >> manifest.boards) || key != "boards"
+        || !(file >> key >> manifest.parts) || key != "parts"
+        || manifest.boards <= 0 || manifest.parts <= 0 || manifest.parts > manifest.boards)
+    {
+        throw std::runtime_error("Invalid LUT manifest");
+    }
+
+    return manifest;
+}
+
+std::string get_lut_part_filename(const std::string& filename, const int part)
+{
+    return filename + ".part" + std::to_string(part);
+}
+
+std::pair<std::int64_t, std::int64_t> get_lut_part_boards(const lut_manifest& manifest, const int part)
+{
+    if (part < 0 || part >= manifest.parts)
+        throw std::runtime_error("Invalid LUT part");
+
+    return std::make_pair(manifest.boards * part / manifest.parts, manifest.boards * (part + 1) / manifest.parts);
+}
+
+bool is_lut_part_complete(const std::string& filename, const lut_manifest& manifest, const int part,
+    const std::size_t value_size)
+{
+    auto file = binary_open(get_lut_part_filename(filename, part), "rb");
+
+    if (!file)
+        return false;
+
+    lut_part_header header;
+
+    if (std::fread(&header, sizeof(header), 1, file.get()) != 1)
+        return false;
+
+    const auto boards = get_lut_part_boards(manifest, part);
+
+    if (header.magic != LUT_PART_MAGIC || header.version != LUT_PART_VERSION || header.value_size != value_size
+        || header.first_board != boards.first || header.last_board != boards.second)
+    {
+        return false;
+    }
+
+    // parts are renamed into place once complete but a truncated copy from another machine is still possible
+    if (std::fseek(file.get(), 0, SEEK_END) != 0)
+        return false;
+
+    const auto size = static_cast<std::uint64_t>(std::ftell(file.get()));
+    return size == sizeof(header) + header.count * (sizeof(hand_indexer::hand_index_t) + value_size);
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+#ifdef _MSC_VER
+#pragma warning(push, 1)
+#endif
+#include <omp.h>
+#include <array>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <utility>
+#include <iostream>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <boost/interprocess/sync/file_lock.hpp>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+#include "hand_indexer.h"
+#include "util/binary_io.h"
+#include "lut_file.h"
+
+class holdem_evaluator;
+
+// River LUTs are generated from the hole card pairs on canonical boards: every canonical river hand has a suit
+// permutation that maps its board to a canonical board so these hands cover the whole table, and hands on different
+// canonical boards never share an index. A build can be split into parts over contiguous ranges of canonical boards
+// which are generated by separate processes or machines and merged into the final LUT file afterwards.
+//
+// The manifest (<lut file>.manifest) records how the boards are split. Each part is written to
+// <lut file>.part<n> as [lut_part_header][(index, value)...] under a temporary name and renamed once complete,
+// so an interrupted build is resumed by generating the same parts again; complete parts are skipped. A process
+// generating a part holds a lock on <lut file>.part<n>.lock, which the system releases if the process dies, and
+// other processes skip parts that are locked.
+
+struct lut_manifest
+{
+    std::string lut;
+    std::int64_t boards;
+    int parts;
+};
+
+struct lut_part_header
+{
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t value_size;
+    std::int64_t first_board;
+    std::int64_t last_board;
+    std::uint64_t count;
+};
+
+static const std::uint64_t LUT_PART_MAGIC = 0x50544c534144494dull; // "MIDASLTP"
+static const std::uint32_t LUT_PART_VERSION = 1;
+
+// hole card pairs on a river board
+static const int BOARD_PAIRS = (CARDS - 5) * (CARDS - 6) / 2;
+
+std::int64_t get_canonical_board_count();
+void get_canonical_board(std::int64_t board_index, card_t board[]);
+
+// evaluates every hole card pair on the board: writes the hand of pair i to hands[i * 7] and its river index to
+// indices[i], and the (hand value, pair) of all BOARD_PAIRS pairs to hand_values sorted by hand value
+void evaluate_board_pairs(const holdem_evaluator& e, const hand_indexer& indexer, const card_t board[],
+    card_t hands[], std::pair<int, int> hand_values[], hand_indexer::hand_index_t indices[]);
+
+// reads the manifest of the LUT file or creates it if it doesn't exist yet; parts may be zero to use the existing
+// manifest, otherwise it must match
+lut_manifest open_lut_manifest(const std::string& filename, const std::string& lut, int parts);
+lut_manifest read_lut_manifest(const std::string& filename);
+std::string get_lut_part_filename(const std::string& filename, int part);
+std::pair<std::int64_t, std::int64_t> get_lut_part_boards(const lut_manifest& manifest, int part);
+bool is_lut_part_complete(const std::string& filename, const lut_manifest& manifest, int part,
+    std::size_t value_size);
+
+// receives generated entries in board order
+template<class T>
+using lut_entries_writer = std::function<void(const hand_indexer::hand_index_t indices[], const T values[],
+    std::size_t count)>;
+
+// calls create_board(board, indices, values) for every canonical board in [first_board, last_board) in parallel,
+// each call writing board_pairs entries, and passes the unique entries of each board to write in board order
+template<class T, class F>
+void create_board_entries(const std::int64_t first_board, const std::int64_t last_board, F create_board,
+    const int board_pairs, const lut_entries_writer<T>& write)
+{
+    // boards are generated in blocks to bound the memory held before writing
+    static const std::int64_t BLOCK_SIZE = 1024;
+
+    std::vector<std::vector<hand_indexer::hand_index_t>> indices(BLOCK_SIZE);
+    std::vector<std::vector<T>> values(BLOCK_SIZE);
+
+    for (std::int64_t block = first_board; block < last_board; block += BLOCK_SIZE)
+    {
+        const auto block_end = std::min(last_board, block + BLOCK_SIZE);
+
+#pragma omp parallel
+        {
+            std::array<card_t, 5> board;
+            std::vector<hand_indexer::hand_index_t> board_indices(board_pairs);
+            std::vector<T> board_values(board_pairs);
+            std::vector<int> order(board_pairs);
+
+#pragma omp for schedule(dynamic)
+            for (std::int64_t i = block; i < block_end; ++i)
+            {
+                get_canonical_board(i, board.data());
+                create_board(board.data(), board_indices.data(), board_values.data());
+
+                // hole card pairs which are suit isomorphic on this board share an index
+                std::iota(order.begin(), order.end(), 0);
+                std::sort(order.begin(), order.end(), [&](const int a, const int b)
+                    { return board_indices[a] < board_indices[b]; });
+
+                auto& block_indices = indices[static_cast<std::size_t>(i - block)];
+                auto& block_values = values[static_cast<std::size_t>(i - block)];
+                block_indices.clear();
+                block_values.clear();
+
+                for (const auto j : order)
+                {
+                    if (block_indices.empty() || block_indices.back() != board_indices[j])
+                    {
+                        block_indices.push_back(board_indices[j]);
+                        block_values.push_back(board_values[j]);
+                    }
+                }
+            }
+        }
+
+        for (std::int64_t i = block; i < block_end; ++i)
+        {
+            const auto j = static_cast<std::size_t>(i - block);
+            write(indices[j].data(), values[j].data(), indices[j].size());
+        }
+    }
+}
+
+template<class Lut>
+void create_lut_part(const std::string& filename, const lut_manifest& manifest, const int part)
+{
+    typedef typename Lut::data_type data_type;
+
+    const auto part_filename = get_lut_part_filename(filename, part);
+    const auto lock_filename = part_filename + ".lock";
+
+    if (!binary_open(lock_filename, "ab"))
+        throw std::runtime_error("Unable to create LUT part lock file");
+
+    boost::interprocess::file_lock lock(lock_filename.c_str());
+
+    if (!lock.try_lock())
+    {
+        std::cout << part_filename << " is being generated by another process, skipping\n";
+        return;
+    }
+
+    // checked under the lock as another process may have just completed the part
+    if (is_lut_part_complete(filename, manifest, part, sizeof(data_type)))
+    {
+        std::cout << part_filename << " is complete, skipping\n";
+        return;
+    }
+
+    const auto boards = get_lut_part_boards(manifest, part);
+    std::cout << "generating " << part_filename << " (boards " << boards.first << "-" << boards.second << ")\n";
+
+    lut_part_header header;
+    header.magic = LUT_PART_MAGIC;
+    header.version = LUT_PART_VERSION;
+    header.value_size = sizeof(data_type);
+    header.first_board = boards.first;
+    header.last_board = boards.second;
+    header.count = 0;
+
+    const auto temp_filename = part_filename + ".tmp";
+
+    {
+        auto file = binary_open(temp_filename, "wb");
+
+        if (!file)
+            throw std::runtime_error("Unable to create LUT part file");
+
+        // the entry count is filled in once all boards are written
+        binary_write(*file, header);
+
+        Lut::create_boards(boards.first, boards.second, [&](const typename Lut::index_t indices[],
+            const data_type values[], const std::size_t count)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                binary_write(*file, &indices[i], 1);
+                binary_write(*file, &values[i], 1);
+            }
+
+            header.count += count;
+        });
+
+        if (std::fseek(file.get(), 0, SEEK_SET) != 0)
+            throw std::runtime_error("Unable to write LUT part file");
+
+        binary_write(*file, header);
+
+        if (std::fflush(file.get()) != 0)
+            throw std::runtime_error("Unable to write LUT part file");
+    }
+
+    std::remove(part_filename.c_str());
+
+    if (std::rename(temp_filename.c_str(), part_filename.c_str()) != 0)
+        throw std::runtime_error("Unable to rename LUT part file");
+
+    // processes still waiting on the lock find the part complete
+    std::remove(lock_filename.c_str());
+}
+
+// assembles the final LUT file from all parts listed in the manifest
+template<class Lut>
+void merge_lut_parts(const std::string& filename, const lut_manifest& manifest, const lut_file::format_type format)
+{
+    typedef typename Lut::data_type data_type;
+
+    std::vector<data_type> data(Lut::get_size());
+    std::vector<bool> written(data.size());
+    std::uint64_t count = 0;
+
+    for (int part = 0; part < manifest.parts; ++part)
+    {
+        const auto part_filename = get_lut_part_filename(filename, part);
+
+        if (!is_lut_part_complete(filename, manifest, part, sizeof(data_type)))
+            throw std::runtime_error("LUT part is missing or incomplete: " + part_filename);
+
+        auto file = binary_open(part_filename, "rb");
+
+        if (!file)
+            throw std::runtime_error("Unable to open LUT part file");
+
+        lut_part_header header;
+        binary_read(*file, header);
+
+        for (std::uint64_t i = 0; i < header.count; ++i)
+        {
+            typename Lut::index_t index;
+            binary_read(*file, index);
+
+            if (index >= data.size())
+                throw std::runtime_error("Invalid index in LUT part file");
+
+            // parts cover disjoint board ranges and hands on different boards never share an index
+            if (written[index])
+                throw std::runtime_error("Duplicate index in LUT part file: " + part_filename);
+
+            written[index] = true;
+            binary_read(*file, &data[index], 1);
+        }
+
+        count += header.count;
+    }
+
+    // without duplicates all indices are written once the count matches
+    if (count != data.size())
+        throw std::runtime_error("LUT parts do not cover the whole table");
+
+    const auto temp_filename = filename + ".tmp";
+    Lut::save(temp_filename, data.data(), data.size(), format);
+
+    std::remove(filename.c_str());
+
+    if (std::rename(temp_filename.c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("Unable to rename LUT file");
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#ifdef _MSC_VER
+#pragma warning(push, 1)
+#endif
+#include <array>
+#include <vector>
+#include <memory>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <stdexcept>
+#include <type_traits>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+#include "lut_file.h"
+
+// The entries of a LUT, Dimensions values of type T each, either generated in memory or loaded from a lut_file.
+// Tables held as floats are read in place while the codes of quantized files are decoded one entry at a time as
+// code / Scale. Quantized files are written with codes rounded from values in [0, 1] for lut_file::UNIT_SCALE,
+// for any other scale the values have to be multiples of 1 / Scale so that decoding gives them back exactly.
+template<class T, int Dimensions, int Scale = lut_file::UNIT_SCALE>
+class lut_table
+{
+public:
+    typedef typename std::conditional<Dimensions == 1, T, std::array<T, Dimensions>>::type data_type;
+
+    static_assert(std::is_same<T, float>::value, "LUT files store floats");
+    static_assert(sizeof(data_type) == Dimensions * sizeof(T), "entries are read in place from the file");
+
+    // a generated table, filled through get_generated
+    explicit lut_table(std::size_t size);
+    // the file is mapped read-only, see lut_file
+    lut_table(const std::string& filename, std::size_t size, bool preload);
+    data_type get(std::size_t index) const;
+    // all values if the table is held as floats, nullptr otherwise
+    const data_type* get_data() const;
+    // all values of a generated table
+    data_type* get_generated();
+    std::size_t get_size() const;
+    // format of the loaded file, LUT_FLOAT for generated tables
+    lut_file::format_type get_format() const;
+    // quantized tables are decoded before they are written
+    void save(const std::string& filename, lut_file::format_type format) const;
+
+    static void save(const std::string& filename, const data_type* data, std::size_t size,
+        lut_file::format_type format);
+
+private:
+    // generated tables are held in memory while loaded tables point into the mapped file
+    std::vector<data_type> generated_;
+    std::unique_ptr<lut_file> file_;
+    const data_type* data_;
+    std::size_t size_;
+};
+
+template<class T, int Dimensions, int Scale>
+lut_table<T, Dimensions, Scale>::lut_table(const std::size_t size)
+    : generated_(size)
+    , data_(generated_.data())
+    , size_(size)
+{
+}
+
+template<class T, int Dimensions, int Scale>
+lut_table<T, Dimensions, Scale>::lut_table(const std::string& filename, const std::size_t size, const bool preload)
+    : file_(new lut_file(filename, size, Dimensions, preload))
+    , data_(reinterpret_cast<const data_type*>(file_->get_floats()))
+    , size_(size)
+{
+}
+
+template<class T, int Dimensions, int Scale>
+typename lut_table<T, Dimensions, Scale>::data_type lut_table<T, Dimensions, Scale>::get(const std::size_t index) const
+{
+    assert(index < size_);
+
+    if (data_)
+        return data_[index];
+
+    std::array<std::uint16_t, Dimensions> codes;
+    file_->get_codes(index, codes.data());
+
+    // same expression as the exact values of the river LUT so decoding them is exact
+    std::array<T, Dimensions> values;
+
+    for (int d = 0; d < Dimensions; ++d)
+        values[d] = T(codes[d] / double(Scale));
+
+    data_type data;
+    std::memcpy(&data, values.data(), sizeof(data));
+    return data;
+}
+
+template<class T, int Dimensions, int Scale>
+const typename lut_table<T, Dimensions, Scale>::data_type* lut_table<T, Dimensions, Scale>::get_data() const
+{
+    return data_;
+}
+
+template<class T, int Dimensions, int Scale>
+typename lut_table<T, Dimensions, Scale>::data_type* lut_table<T, Dimensions, Scale>::get_generated()
+{
+    assert(!file_);
+    return generated_.data();
+}
+
+template<class T, int Dimensions, int Scale>
+std::size_t lut_table<T, Dimensions, Scale>::get_size() const
+{
+    return size_;
+}
+
+template<class T, int Dimensions, int Scale>
+lut_file::format_type lut_table<T, Dimensions, Scale>::get_format() const
+{
+    return file_ ? file_->get_format() : lut_file::LUT_FLOAT;
+}
+
+template<class T, int Dimensions, int Scale>
+void lut_table<T, Dimensions, Scale>::save(const std::string& filename, const lut_file::format_type format) const
+{
+    if (data_)
+    {
+        save(filename, data_, size_, format);
+        return;
+    }
+
+    std::vector<data_type> data(size_);
+
+#pragma omp parallel for
+    for (std::int64_t i = 0; i < static_cast<std::int64_t>(size_); ++i)
+        data[i] = get(static_cast<std::size_t>(i));
+
+    save(filename, data.data(), data.size(), format);
+}
+
+template<class T, int Dimensions, int Scale>
+void lut_table<T, Dimensions, Scale>::save(const std::string& filename, const data_type* data, const std::size_t size,
+    const lut_file::format_type format)
+{
+    const auto values = reinterpret_cast<const T*>(data);
+
+    if (format == lut_file::LUT_FLOAT)
+    {
+        lut_file::write_floats(filename, values, size, Dimensions);
+        return;
+    }
+
+    if (Scale == lut_file::UNIT_SCALE)
+    {
+        lut_file::write_units(filename, format, values, size, Dimensions);
+        return;
+    }
+
+    std::vector<std::uint16_t> codes(size * Dimensions);
+    bool exact = true;
+
+#pragma omp parallel for reduction(&&:exact)
+    for (std::int64_t i = 0; i < static_cast<std::int64_t>(codes.size()); ++i)
+    {
+        codes[i] = static_cast<std::uint16_t>(std::lround(values[i] * double(Scale)));
+        exact = exact && T(codes[i] / double(Scale)) == values[i];
+    }
+
+    if (!exact)
+        throw std::runtime_error("LUT values are not multiples of 1/" + std::to_string(Scale));
+
+    lut_file::write_codes(filename, format, codes.data(), size, Dimensions);
+}
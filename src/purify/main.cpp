@@ -8,10 +8,14 @@
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <random>
 #include <numeric>
+#include <atomic>
+#include <exception>
+#include <omp.h>
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 #include "cfrlib/nlhe_strategy.h"
+#include "cfrlib/strategy_writer.h"
 #include "util/version.h"
 
 void apply_purification(strategy::probability_t* begin, strategy::probability_t* end)
@@ -69,8 +73,8 @@ void apply_thresholding(strategy::probability_t* begin, strategy::probability_t*
         *it /= sum;
 }
 
-void apply_new(const nlhe_state& state, strategy::probability_t* begin, strategy::probability_t* end,
-    const double threshold)
+// child apply_new collapses the row to, or -1 if it purifies the row among the bets
+int get_new_child(const nlhe_state& state, const strategy::probability_t* begin, const double threshold)
 {
     int fold_index = -1;
     int call_index = -1;
@@ -101,9 +105,7 @@ void apply_new(const nlhe_state& state, strategy::probability_t* begin, strategy
         if (fold_index == -1)
             throw std::runtime_error("fold_index == -1");
 
-        std::fill(begin, end, strategy::probability_t());
-        *(begin + fold_index) = 1;
-        return;
+        return fold_index;
     }
 
     if (call >= bet)
@@ -111,20 +113,103 @@ void apply_new(const nlhe_state& state, strategy::probability_t* begin, strategy
         if (call_index == -1)
             throw std::runtime_error("call_index == -1");
 
+        return call_index;
+    }
+
+    return -1;
+}
+
+void apply_new(const nlhe_state& state, strategy::probability_t* begin, strategy::probability_t* end,
+    const double threshold)
+{
+    const int child = get_new_child(state, begin, threshold);
+
+    if (child != -1)
+    {
         std::fill(begin, end, strategy::probability_t());
-        *(begin + call_index) = 1;
+        *(begin + child) = 1;
         return;
     }
 
-    if (fold_index != -1)
-        *(begin + fold_index) = 0;
+    for (int i = 0; i < state.get_child_count(); ++i)
+    {
+        const auto action = state.get_child(i)->get_action();
 
-    if (call_index != -1)
-        *(begin + call_index) = 0;
+        if (action == nlhe_state::FOLD || action == nlhe_state::CALL)
+            *(begin + i) = 0;
+    }
 
     apply_purification(begin, end);
 }
 
+enum method_type
+{
+    PURIFICATION,
+    THRESHOLDING,
+    NEW,
+    NONE,
+};
+
+void apply_method(const method_type method, const nlhe_state& state, strategy::probability_t* begin,
+    strategy::probability_t* end, const double threshold)
+{
+    switch (method)
+    {
+    case PURIFICATION:
+        apply_purification(begin, end);
+        break;
+    case THRESHOLDING:
+        apply_thresholding(begin, end, threshold);
+        break;
+    case NEW:
+        apply_new(state, begin, end, threshold);
+        break;
+    case NONE:
+        break;
+    default:
+        throw std::runtime_error("Unknown post-processing method");
+    }
+
+    assert(std::abs(std::accumulate(begin, end, 0.0) - 1.0) <= 1e-5);
+}
+
+// calls f(i) for i in [first, last) in parallel and returns the sum of the results. Exceptions can't leave an
+// OpenMP region so the first one stops the remaining iterations and is rethrown after the loop
+template<class F>
+std::int64_t parallel_sum(const std::int64_t first, const std::int64_t last, F f)
+{
+    std::int64_t sum = 0;
+    std::exception_ptr error;
+    std::atomic<bool> failed(false);
+
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:sum)
+    for (std::int64_t i = first; i < last; ++i)
+    {
+        if (failed)
+            continue;
+
+        try
+        {
+            sum += f(i);
+        }
+        catch (...)
+        {
+#pragma omp critical
+            {
+                if (!error)
+                    error = std::current_exception();
+            }
+
+            failed = true;
+        }
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+
+    return sum;
+}
+
 int main(int argc, char* argv[])
 {
     try
@@ -144,9 +229,13 @@ int main(int argc, char* argv[])
         namespace po = boost::program_options;
 
         std::string strategy_file;
+        std::vector<std::string> output_files;
+        std::string output_format;
         double threshold;
-        int method;
+        std::vector<int> methods;
         int round;
+        int threads;
+        int chunk_size;
 
         po::options_description desc("Options");
         desc.add_options()
@@ -154,8 +243,16 @@ int main(int argc, char* argv[])
             ("strategy-file", po::value<std::string>(&strategy_file)->required(), "strategy file")
             ("version", "show version")
             ("threshold", po::value<double>(&threshold)->default_value(0.0), "threshold parameter")
-            ("method", po::value<int>(&method)->default_value(0), "post-processing method")
+            ("method", po::value<std::vector<int>>(&methods)->multitoken()->default_value(std::vector<int>(1, 0), "0"),
+                "post-processing methods (0 = purification, 1 = thresholding, 2 = new, 3 = none)")
             ("round", po::value<int>(&round)->default_value(0), "first round to process")
+            ("output-file", po::value<std::vector<std::string>>(&output_files)->multitoken(),
+                "write the results to new files (one per method) instead of modifying the strategy file in place")
+            ("output-format", po::value<std::string>(&output_format)->default_value("float"),
+                "output file format (float, uint16, uint8)")
+            ("threads", po::value<int>(&threads)->default_value(omp_get_max_threads()), "number of threads")
+            ("chunk-size", po::value<int>(&chunk_size)->default_value(4096),
+                "number of states processed in parallel before being written to the output files")
             ;
 
         po::variables_map vm;
@@ -178,34 +275,155 @@ int main(int argc, char* argv[])
         BOOST_LOG_TRIVIAL(info) << "purify " << util::GIT_VERSION;
         BOOST_LOG_TRIVIAL(info) << "Purifying " << strategy_file;
 
-        nlhe_strategy strategy(strategy_file, false);
-        const auto states = game_state_base::get_state_vector(strategy.get_root_state());
+        const bool in_place = output_files.empty();
+
+        if (in_place && methods.size() != 1)
+            throw std::runtime_error("Multiple methods require one output file per method");
 
-        std::size_t count = 0;
+        if (!in_place && output_files.size() != methods.size())
+            throw std::runtime_error("Output file count must match method count");
 
-        for (int state_id = 0; state_id < static_cast<int>(states.size()); ++state_id)
+        if (chunk_size < 1)
+            throw std::runtime_error("Invalid chunk size");
+
+        for (const auto method : methods)
         {
-            const auto& state = *dynamic_cast<const nlhe_state*>(states[state_id]);
+            if (method < PURIFICATION || method > NONE)
+                throw std::runtime_error("Unknown post-processing method");
+        }
 
-            if (state.get_round() < round)
-                continue;
+        omp_set_num_threads(threads);
 
-            for (int bucket = 0; bucket < strategy.get_abstraction().get_bucket_count(state.get_round()); ++bucket)
+        nlhe_strategy strategy(strategy_file, !in_place);
+        const auto& abstraction = strategy.get_abstraction();
+        const auto states = game_state_base::get_state_vector(strategy.get_root_state());
+        const auto state_count = static_cast<std::int64_t>(states.size());
+        std::int64_t count = 0;
+
+        if (in_place)
+        {
+            const auto method = static_cast<method_type>(methods[0]);
+
+            // the new method rejects rows it can't collapse to a legal action, which is checked for every row
+            // before any is rewritten so an error doesn't leave the file half processed
+            if (method == NEW)
             {
-                strategy::probability_t* begin = strategy.get_strategy().get_data(state, 0, bucket);
-                strategy::probability_t* end = begin + state.get_child_count();
+                parallel_sum(0, state_count, [&](const std::int64_t state_id) -> std::int64_t
+                {
+                    const auto& state = *dynamic_cast<const nlhe_state*>(states[state_id]);
 
-                if (method == 0)
-                    apply_purification(begin, end);
-                else if (method == 1)
-                    apply_thresholding(begin, end, threshold);
-                else if (method == 2)
-                    apply_new(state, begin, end, threshold);
+                    if (state.get_round() < round)
+                        return 0;
 
-                assert(std::abs(std::accumulate(begin, end, 0.0) - 1.0) <= 1e-5);
+                    for (int bucket = 0; bucket < abstraction.get_bucket_count(state.get_round()); ++bucket)
+                        get_new_child(state, strategy.get_strategy().get_data(state, 0, bucket), threshold);
 
-                ++count;
+                    return 0;
+                });
             }
+
+            // states own disjoint rows of the mapped file so they can be rewritten concurrently
+            count = parallel_sum(0, state_count, [&](const std::int64_t state_id) -> std::int64_t
+            {
+                const auto& state = *dynamic_cast<const nlhe_state*>(states[state_id]);
+
+                if (state.get_round() < round)
+                    return 0;
+
+                const int buckets = abstraction.get_bucket_count(state.get_round());
+
+                for (int bucket = 0; bucket < buckets; ++bucket)
+                {
+                    auto begin = strategy.get_strategy().get_data(state, 0, bucket);
+                    apply_method(method, state, begin, begin + state.get_child_count(), threshold);
+                }
+
+                return buckets;
+            });
+        }
+        else
+        {
+            std::vector<int> bucket_counts;
+
+            for (int i = 0; i < holdem_state::ROUNDS; ++i)
+                bucket_counts.push_back(abstraction.get_bucket_count(static_cast<holdem_state::game_round>(i)));
+
+            const auto header = strategy::create_header(strategy::parse_format(output_format), strategy.get_game(),
+                strategy.get_abstraction_name(), bucket_counts);
+
+            std::vector<std::unique_ptr<strategy_writer>> writers;
+
+            for (const auto& output_file : output_files)
+            {
+                BOOST_LOG_TRIVIAL(info) << "Writing " << output_file << " (" << output_format << ")";
+                writers.emplace_back(new strategy_writer(output_file, header));
+            }
+
+            // each chunk of states is read once and processed in parallel for every method, then appended to the
+            // output files in state order so that the writers only ever stream sequentially
+            std::vector<std::vector<std::vector<strategy::probability_t>>> rows(methods.size(),
+                std::vector<std::vector<strategy::probability_t>>(chunk_size));
+
+            for (std::int64_t first = 0; first < state_count; first += chunk_size)
+            {
+                const auto last = std::min(first + chunk_size, state_count);
+
+                count += parallel_sum(first, last, [&](const std::int64_t state_id) -> std::int64_t
+                {
+                    const auto& state = *dynamic_cast<const nlhe_state*>(states[state_id]);
+                    const int children = state.get_child_count();
+                    const int buckets = abstraction.get_bucket_count(state.get_round());
+                    auto& source = rows[0][state_id - first];
+
+                    source.resize(std::size_t(buckets) * children);
+
+                    for (int bucket = 0; bucket < buckets; ++bucket)
+                        strategy.get_strategy().get_probabilities(state, bucket, source.data() + bucket * children);
+
+                    if (state.get_round() < round)
+                    {
+                        for (std::size_t m = 1; m < methods.size(); ++m)
+                            rows[m][state_id - first] = source;
+
+                        return 0;
+                    }
+
+                    // apply the first method last so that its input row can be shared by the others
+                    for (std::size_t m = methods.size(); m-- > 0;)
+                    {
+                        auto& row = rows[m][state_id - first];
+
+                        if (m != 0)
+                            row = source;
+
+                        for (int bucket = 0; bucket < buckets; ++bucket)
+                        {
+                            auto begin = row.data() + bucket * children;
+                            apply_method(static_cast<method_type>(methods[m]), state, begin, begin + children,
+                                threshold);
+                        }
+                    }
+
+                    return buckets;
+                });
+
+                for (std::size_t m = 0; m < methods.size(); ++m)
+                {
+                    for (std::int64_t state_id = first; state_id < last; ++state_id)
+                    {
+                        const auto& row = rows[m][state_id - first];
+                        const int children = states[state_id]->get_child_count();
+
+                        writers[m]->add_state();
+
+                        for (std::size_t i = 0; i < row.size(); i += children)
+                            writers[m]->add_probabilities(row.data() + i, row.data() + i + children);
+                    }
+                }
+            }
+
+            for (auto& writer : writers)
+                writer->close();
         }
 
         BOOST_LOG_TRIVIAL(info) << count << " action tuples modified";
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <numeric>
+#include <cstddef>
+
+// Read-only normalized histogram stored as integer counts, e.g. 50 bins of uint8 take 56 bytes instead of the 200
+// bytes of std::array<float, 50>. Elements are the normalized frequencies, computed on access.
+template<class T, std::size_t N>
+class compact_histogram
+{
+public:
+    typedef float value_type;
+    typedef std::size_t size_type;
+
+    compact_histogram()
+        : counts_()
+        , scale_(0)
+    {
+    }
+
+    explicit compact_histogram(const std::array<T, N>& counts)
+        : counts_(counts)
+    {
+        const auto sum = std::accumulate(counts.begin(), counts.end(), std::size_t());
+        scale_ = sum > 0 ? 1.0f / sum : 0;
+    }
+
+    value_type operator[](const size_type i) const
+    {
+        return counts_[i] * scale_;
+    }
+
+    static constexpr size_type size()
+    {
+        return N;
+    }
+
+    const std::array<T, N>& get_counts() const
+    {
+        return counts_;
+    }
+
+    // element i is get_counts()[i] * get_scale()
+    float get_scale() const
+    {
+        return scale_;
+    }
+
+private:
+    std::array<T, N> counts_;
+    float scale_;
+};
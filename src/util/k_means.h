@@ -5,14 +5,23 @@
 #endif
 #include <random>
 #include <cassert>
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 
 namespace detail
 {
-    template<class T>
-    void vector_add(T& a, const T& b)
+    template<class T, class U>
+    void vector_add(T& a, const U& b)
     {
         assert(a.size() == b.size());
 
@@ -20,8 +29,8 @@ namespace detail
             a[i] += b[i];
     }
 
-    template<class T>
-    void vector_sub(T& a, const T& b)
+    template<class T, class U>
+    void vector_sub(T& a, const U& b)
     {
         assert(a.size() == b.size());
 
@@ -29,6 +38,30 @@ namespace detail
             a[i] -= b[i];
     }
 
+    template<class T, class U>
+    void vector_add(T& a, const U& b, const std::size_t weight)
+    {
+        assert(a.size() == b.size());
+
+        for (std::size_t i = 0; i < a.size(); ++i)
+            a[i] += b[i] * weight;
+    }
+
+    template<class T, class U>
+    void vector_sub(T& a, const U& b, const std::size_t weight)
+    {
+        assert(a.size() == b.size());
+
+        for (std::size_t i = 0; i < a.size(); ++i)
+            a[i] -= b[i] * weight;
+    }
+
+    // points are unweighted if the weight vector is empty
+    inline std::size_t get_weight(const std::vector<std::size_t>& weights, const std::size_t point)
+    {
+        return weights.empty() ? 1 : weights[point];
+    }
+
     template<class T>
     typename T::value_type mean(const T& x)
     {
@@ -36,138 +69,627 @@ namespace detail
     }
 
     template<class T>
-    double calculate_variance_mean(const T& points)
+    double calculate_variance_mean(const T& points, const std::vector<std::size_t>& weights)
     {
         const auto dimensions = points[0].size();
         std::vector<double> variances(dimensions);
+        double total_weight = 0;
+
+        for (std::size_t point = 0; point < points.size(); ++point)
+            total_weight += get_weight(weights, point);
 
         for (std::size_t dim = 0; dim < dimensions; ++dim)
         {
             double mean = 0;
             
             for (std::size_t point = 0; point < points.size(); ++point)
-                mean += points[point][dim];
+                mean += points[point][dim] * get_weight(weights, point);
 
-            mean /= points.size();
+            mean /= total_weight;
 
             variances[dim] = 0;
 
             for (std::size_t point = 0; point < points.size(); ++point)
-                variances[dim] += (points[point][dim] - mean) * (points[point][dim] - mean);
+            {
+                variances[dim] += (points[point][dim] - mean) * (points[point][dim] - mean)
+                    * get_weight(weights, point);
+            }
 
-            variances[dim] /= points.size();
+            variances[dim] /= total_weight;
         }
 
         return mean(variances);
     }
+
+    // seeding works on fixed size blocks of points so that results do not depend on the thread count
+    static const std::size_t BLOCK_SIZE = 4096;
+
+    template<class T>
+    T block_sum(const std::vector<T>& values, const std::vector<std::size_t>& weights)
+    {
+        const auto blocks = (values.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        std::vector<T> block_sums(blocks);
+
+#pragma omp parallel for
+        for (std::int64_t block = 0; block < static_cast<std::int64_t>(blocks); ++block)
+        {
+            const auto end = std::min((block + 1) * BLOCK_SIZE, values.size());
+            T sum = T();
+
+            for (std::size_t i = block * BLOCK_SIZE; i < end; ++i)
+                sum += values[i] * get_weight(weights, i);
+
+            block_sums[block] = sum;
+        }
+
+        return std::accumulate(block_sums.begin(), block_sums.end(), T());
+    }
+
+    // uniform [0, 1) value for the index-th element of a counter based stream (splitmix64 finalizer)
+    inline double get_uniform(const std::uint64_t seed, const std::uint64_t index)
+    {
+        auto z = seed + (index + 1) * 0x9e3779b97f4a7c15ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        return (z >> 11) * (1.0 / (1ull << 53));
+    }
+
+    // converts a (possibly compact) point to the center representation
+    template<class Center, class Point>
+    Center make_center(const Point& point)
+    {
+        Center center;
+
+        for (std::size_t i = 0; i < center.size(); ++i)
+            center[i] = point[i];
+
+        return center;
+    }
+
+    template<class Center, class PointVector>
+    std::vector<Center> make_centers(const PointVector& points)
+    {
+        std::vector<Center> centers;
+        centers.reserve(points.size());
+
+        for (const auto& point : points)
+            centers.push_back(make_center<Center>(point));
+
+        return centers;
+    }
 }
 
 enum init_type { RANDOM, PP, PARALLEL, OPTIMAL };
 
-template<class Point, class ClusterIndex, class DistanceFunction, class CostFunction>
+// HAMERLY keeps a single lower bound per point which is cheap but scans every center whenever it fails, YINYANG
+// keeps one lower bound per group of centers and only scans the groups that fail which pays off for large k
+enum algorithm_type { HAMERLY, YINYANG };
+
+// Points may use a compact read-only representation (e.g. integer histograms) as long as they provide size() and an
+// operator[] returning the coordinate; cluster centers and sums use Center which must be a mutable float array.
+// The distance and cost functions are called with (point, center) and (center, center) arguments.
+template<class Point, class ClusterIndex, class DistanceFunction, class CostFunction, class Center = Point>
 class k_means
 {
 public:
     typedef Point point_t;
     typedef std::vector<point_t> point_vector_t;
+    typedef Center center_t;
+    typedef std::vector<center_t> center_vector_t;
     typedef double distance_t;
     typedef ClusterIndex cluster_idx_t;
     typedef DistanceFunction distance_fun_t;
     typedef CostFunction cost_fun_t;
     typedef std::size_t cluster_size_t;
     typedef std::size_t point_idx_t;
-    typedef typename point_t::size_type dim_idx_t;
+    typedef typename center_t::size_type dim_idx_t;
+    typedef std::vector<cluster_size_t> weight_vector_t;
+
+    // centers per Yinyang group, the group count is capped to bound the per point memory
+    static const int YINYANG_GROUP_SIZE = 10;
+    static const int YINYANG_MAX_GROUPS = 32;
+
+    k_means(algorithm_type algorithm = HAMERLY, std::mt19937::result_type seed = std::random_device()())
+        : algorithm_(algorithm)
+        , engine_(seed)
+        , threads_per_run_(0)
+    {
+    }
 
     distance_t run(const point_vector_t& points, const cluster_idx_t cluster_count, const std::size_t max_iterations,
         const distance_t tolerance, init_type init, const int runs, std::vector<cluster_idx_t>* point_clusters_out,
-        point_vector_t* cluster_centers_out)
+        center_vector_t* cluster_centers_out)
+    {
+        return run(points, weight_vector_t(), cluster_count, max_iterations, tolerance, init, runs, point_clusters_out,
+            cluster_centers_out);
+    }
+
+    // each point counts as weights[i] identical points (all points count once if weights is empty)
+    distance_t run(const point_vector_t& points, const weight_vector_t& weights, const cluster_idx_t cluster_count,
+        const std::size_t max_iterations, const distance_t tolerance, init_type init, const int runs,
+        std::vector<cluster_idx_t>* point_clusters_out, center_vector_t* cluster_centers_out)
     {
-        distance_t min_cost = std::numeric_limits<distance_t>::max();
-        std::vector<cluster_idx_t> iteration_point_clusters;
-        point_vector_t iteration_cluster_centers;
+        assert(weights.empty() || weights.size() == points.size());
+
+        // every restart gets its own seed so that the result does not depend on how the restarts are scheduled
+        std::vector<std::mt19937::result_type> seeds(runs);
+
+        for (auto& seed : seeds)
+            seed = engine_();
+
+        const auto concurrent_runs = threads_per_run_ > 0
+            ? std::max(1, std::min(runs, omp_get_max_threads() / threads_per_run_)) : 1;
 
-        for (int i = 0; i < runs; ++i)
+        // each concurrent slot keeps the best restart it has run, ties are broken by the restart index
+        struct run_result
         {
-            iteration_point_clusters.clear();
-            iteration_cluster_centers.clear();
+            distance_t cost;
+            int run;
+            std::vector<cluster_idx_t> point_clusters;
+            center_vector_t cluster_centers;
+        };
+
+        std::vector<run_result> results(concurrent_runs);
+
+        for (auto& result : results)
+        {
+            result.cost = std::numeric_limits<distance_t>::max();
+            result.run = runs;
+        }
+
+        const auto max_active_levels = omp_get_max_active_levels();
 
-            const auto cost = run_single(points, cluster_count, max_iterations, tolerance, init,
-                &iteration_point_clusters, &iteration_cluster_centers);
+        if (concurrent_runs > 1)
+            omp_set_max_active_levels(std::max(max_active_levels, 2));
 
-            if (cost < min_cost)
+#pragma omp parallel for num_threads(concurrent_runs) schedule(static, 1)
+        for (int run = 0; run < runs; ++run)
+        {
+            // the nested parallel regions of this restart only use its share of the threads
+            if (concurrent_runs > 1)
+                omp_set_num_threads(threads_per_run_);
+
+            auto& result = results[omp_get_thread_num()];
+            std::vector<cluster_idx_t> point_clusters;
+            center_vector_t cluster_centers;
+
+            const auto cost = k_means(algorithm_, seeds[run]).run_single(points, weights, cluster_count,
+                max_iterations, tolerance, init, &point_clusters, &cluster_centers);
+
+            if (cost < result.cost || (cost == result.cost && run < result.run))
             {
-                *point_clusters_out = iteration_point_clusters;
-                *cluster_centers_out = iteration_cluster_centers;
-                min_cost = cost;
+                result.cost = cost;
+                result.run = run;
+                result.point_clusters.swap(point_clusters);
+                result.cluster_centers.swap(cluster_centers);
             }
         }
 
-        return min_cost;
+        omp_set_max_active_levels(max_active_levels);
+
+        auto best = results.begin();
+
+        for (auto it = results.begin(); it != results.end(); ++it)
+        {
+            if (it->cost < best->cost || (it->cost == best->cost && it->run < best->run))
+                best = it;
+        }
+
+        point_clusters_out->swap(best->point_clusters);
+        cluster_centers_out->swap(best->cluster_centers);
+
+        return best->cost;
     }
 
-    distance_t run_single(const point_vector_t& points, const cluster_idx_t cluster_count, const std::size_t max_iterations,
-        const distance_t tolerance, init_type init, std::vector<cluster_idx_t>* point_clusters_out,
-        point_vector_t* cluster_centers_out)
+    // 0 runs the restarts one after another with all threads, otherwise as many restarts as possible run
+    // concurrently with this many threads each
+    void set_threads_per_run(const int threads_per_run)
+    {
+        threads_per_run_ = threads_per_run;
+    }
+
+    // identical points are collapsed into unique points weighted by their multiplicity before clustering and the
+    // assignments are broadcast back, which gives the same partitions for a fraction of the work on data with
+    // many duplicates
+    distance_t run_unique(const point_vector_t& points, const cluster_idx_t cluster_count,
+        const std::size_t max_iterations, const distance_t tolerance, init_type init, const int runs,
+        std::vector<cluster_idx_t>* point_clusters_out, center_vector_t* cluster_centers_out)
+    {
+        point_vector_t unique_points;
+        weight_vector_t weights;
+        std::vector<point_idx_t> unique_indices;
+
+        make_unique_points(points, &unique_points, &weights, &unique_indices);
+
+        std::vector<cluster_idx_t> unique_clusters;
+        distance_t cost = 0;
+
+        if (static_cast<cluster_idx_t>(unique_points.size()) <= cluster_count)
+        {
+            // every unique point gets its own cluster
+            unique_clusters.resize(unique_points.size());
+            std::iota(unique_clusters.begin(), unique_clusters.end(), cluster_idx_t());
+            *cluster_centers_out = detail::make_centers<center_t>(unique_points);
+        }
+        else
+        {
+            cost = run(unique_points, weights, cluster_count, max_iterations, tolerance, init, runs,
+                &unique_clusters, cluster_centers_out);
+        }
+
+        auto& point_clusters = *point_clusters_out;
+        point_clusters.resize(points.size());
+
+#pragma omp parallel for
+        for (std::int64_t point = 0; point < static_cast<std::int64_t>(points.size()); ++point)
+            point_clusters[point] = unique_clusters[unique_indices[point]];
+
+        return cost;
+    }
+
+    // unique_indices maps every point to its unique point, unique points are in order of first occurrence
+    static void make_unique_points(const point_vector_t& points, point_vector_t* unique_points_out,
+        weight_vector_t* weights_out, std::vector<point_idx_t>* unique_indices_out)
+    {
+        make_unique_points(points.data(), points.size(), unique_points_out, weights_out, unique_indices_out);
+    }
+
+    static void make_unique_points(const point_t* points, const std::size_t point_count,
+        point_vector_t* unique_points_out, weight_vector_t* weights_out, std::vector<point_idx_t>* unique_indices_out)
+    {
+        make_unique_points_with([points](const point_idx_t point) -> const point_t& { return points[point]; },
+            point_count, unique_points_out, weights_out, unique_indices_out);
+    }
+
+    // reads the points through get_point(index), which may decode them on the fly so that the points never have
+    // to be held in memory at once. Points are split into shards by hash so that the shards are deduplicated in
+    // parallel with one hash table each; a counting sort keeps the points of every shard in index order so the
+    // result doesn't depend on the thread count
+    template<class F>
+    static void make_unique_points_with(F get_point, const std::size_t point_count,
+        point_vector_t* unique_points_out, weight_vector_t* weights_out, std::vector<point_idx_t>* unique_indices_out)
+    {
+        static const std::size_t SHARDS = 256;
+
+        struct point_hash
+        {
+            std::size_t operator()(const point_t& point) const
+            {
+                typedef typename std::decay<decltype(point[0])>::type value_t;
+                std::size_t seed = 0;
+
+                for (std::size_t i = 0; i < point.size(); ++i)
+                    seed ^= std::hash<value_t>()(point[i]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+
+                return seed;
+            }
+        };
+
+        struct point_equal
+        {
+            bool operator()(const point_t& a, const point_t& b) const
+            {
+                for (std::size_t i = 0; i < a.size(); ++i)
+                {
+                    if (a[i] != b[i])
+                        return false;
+                }
+
+                return true;
+            }
+        };
+
+        struct shard_unique
+        {
+            std::vector<point_idx_t> first_points;
+            weight_vector_t weights;
+            std::vector<point_idx_t> global_indices;
+        };
+
+        auto& unique_points = *unique_points_out;
+        auto& weights = *weights_out;
+        auto& unique_indices = *unique_indices_out;
+        const auto blocks = static_cast<std::int64_t>((point_count + detail::BLOCK_SIZE - 1) / detail::BLOCK_SIZE);
+
+        // the hash is mixed so that shards stay balanced when only its low bits vary
+        std::vector<std::uint8_t> point_shards(point_count);
+        std::vector<point_idx_t> block_offsets(blocks * SHARDS);
+
+#pragma omp parallel for
+        for (std::int64_t block = 0; block < blocks; ++block)
+        {
+            const auto end = std::min((block + 1) * detail::BLOCK_SIZE, point_count);
+
+            for (point_idx_t point = block * detail::BLOCK_SIZE; point < end; ++point)
+            {
+                const auto hash = std::uint64_t(point_hash()(get_point(point))) * 0x9e3779b97f4a7c15ull;
+                point_shards[point] = static_cast<std::uint8_t>(hash >> 56);
+                ++block_offsets[block * SHARDS + point_shards[point]];
+            }
+        }
+
+        // shard major offsets so each shard lists its points in index order
+        std::vector<point_idx_t> shard_ends(SHARDS);
+        point_idx_t offset = 0;
+
+        for (std::size_t shard = 0; shard < SHARDS; ++shard)
+        {
+            for (std::int64_t block = 0; block < blocks; ++block)
+            {
+                const auto count = block_offsets[block * SHARDS + shard];
+                block_offsets[block * SHARDS + shard] = offset;
+                offset += count;
+            }
+
+            shard_ends[shard] = offset;
+        }
+
+        std::vector<point_idx_t> shard_points(point_count);
+
+#pragma omp parallel for
+        for (std::int64_t block = 0; block < blocks; ++block)
+        {
+            const auto end = std::min((block + 1) * detail::BLOCK_SIZE, point_count);
+
+            for (point_idx_t point = block * detail::BLOCK_SIZE; point < end; ++point)
+                shard_points[block_offsets[block * SHARDS + point_shards[point]]++] = point;
+        }
+
+        // unique_indices temporarily holds the index of each point within its shard
+        std::vector<shard_unique> shards(SHARDS);
+        unique_indices.resize(point_count);
+
+#pragma omp parallel for schedule(dynamic)
+        for (std::int64_t shard = 0; shard < static_cast<std::int64_t>(SHARDS); ++shard)
+        {
+            auto& result = shards[shard];
+            std::unordered_map<point_t, point_idx_t, point_hash, point_equal> index_map;
+
+            for (auto i = shard == 0 ? 0 : shard_ends[shard - 1]; i < shard_ends[shard]; ++i)
+            {
+                const auto point = shard_points[i];
+                const auto it = index_map.emplace(get_point(point), result.first_points.size());
+
+                if (it.second)
+                {
+                    result.first_points.push_back(point);
+                    result.weights.push_back(0);
+                }
+
+                unique_indices[point] = it.first->second;
+                ++result.weights[it.first->second];
+            }
+        }
+
+        std::vector<point_idx_t>().swap(shard_points);
+
+        // unique points are numbered in order of first occurrence across all shards
+        std::vector<std::pair<point_idx_t, std::pair<std::size_t, point_idx_t>>> firsts;
+
+        for (std::size_t shard = 0; shard < SHARDS; ++shard)
+        {
+            for (point_idx_t i = 0; i < shards[shard].first_points.size(); ++i)
+                firsts.emplace_back(shards[shard].first_points[i], std::make_pair(shard, i));
+
+            shards[shard].global_indices.resize(shards[shard].first_points.size());
+        }
+
+        std::sort(firsts.begin(), firsts.end());
+
+        unique_points.resize(firsts.size());
+        weights.resize(firsts.size());
+
+        for (point_idx_t i = 0; i < firsts.size(); ++i)
+        {
+            auto& shard = shards[firsts[i].second.first];
+            unique_points[i] = get_point(firsts[i].first);
+            weights[i] = shard.weights[firsts[i].second.second];
+            shard.global_indices[firsts[i].second.second] = i;
+        }
+
+#pragma omp parallel for
+        for (std::int64_t point = 0; point < static_cast<std::int64_t>(point_count); ++point)
+            unique_indices[point] = shards[point_shards[point]].global_indices[unique_indices[point]];
+    }
+
+    distance_t run_single(const point_vector_t& points, const weight_vector_t& weights,
+        const cluster_idx_t cluster_count, const std::size_t max_iterations, const distance_t tolerance,
+        init_type init, std::vector<cluster_idx_t>* point_clusters_out, center_vector_t* cluster_centers_out)
     {
         assert(cluster_count < static_cast<cluster_idx_t>(points.size()));
 
         auto& point_clusters = *point_clusters_out;
         auto& cluster_centers = *cluster_centers_out;
+
+        cluster_centers = init_centers(points, weights, cluster_count, init);
+
+        point_clusters.resize(points.size());
+
+        if (algorithm_ == YINYANG && cluster_count >= 2 * YINYANG_GROUP_SIZE)
+            iterate_yinyang(points, weights, max_iterations, tolerance, &cluster_centers, &point_clusters);
+        else
+            iterate_hamerly(points, weights, max_iterations, tolerance, &cluster_centers, &point_clusters);
+
+        std::vector<distance_t> costs(points.size(), std::numeric_limits<distance_t>::max());
+
+#pragma omp parallel for
+        for (std::int64_t point = 0; point < static_cast<std::int64_t>(points.size()); ++point)
+        {
+            update_cost(points[point], cluster_centers, 0, &costs[point], &point_clusters[point]);
+            costs[point] *= detail::get_weight(weights, point);
+        }
+
+        const auto cost = std::accumulate(costs.begin(), costs.end(), distance_t());
+
+        return cost;
+    }
+
+    // Mini-batch k-means (Sculley 2010) over a point range which may be memory mapped: the centers are seeded from
+    // a uniform sample and then updated with per center learning rates from random batches, so only
+    // iterations * batch_size points are read. If assign_all is set every point is assigned to its closest center
+    // in a final pass and the exact cost is returned, otherwise the cost is estimated from the last batch.
+    distance_t run_mini_batch(const point_t* points, const std::size_t point_count, const cluster_idx_t cluster_count,
+        const std::size_t batch_size, const std::size_t iterations, init_type init, bool assign_all,
+        std::vector<cluster_idx_t>* point_clusters_out, center_vector_t* cluster_centers_out)
+    {
+        return run_mini_batch(points, point_count, weight_vector_t(), cluster_count, batch_size, iterations, init,
+            assign_all, point_clusters_out, cluster_centers_out);
+    }
+
+    // each point counts as weights[i] identical points (all points count once if weights is empty), so batches
+    // over unique points sample the same distribution as batches over all points
+    distance_t run_mini_batch(const point_t* points, const std::size_t point_count, const weight_vector_t& weights,
+        const cluster_idx_t cluster_count, const std::size_t batch_size, const std::size_t iterations,
+        init_type init, bool assign_all, std::vector<cluster_idx_t>* point_clusters_out,
+        center_vector_t* cluster_centers_out)
+    {
+        assert(cluster_count < static_cast<cluster_idx_t>(point_count) && batch_size > 0);
+        assert(weights.empty() || weights.size() == point_count);
+
+        auto& cluster_centers = *cluster_centers_out;
+        std::uniform_int_distribution<point_idx_t> uniform_dist(0, point_count - 1);
+        std::discrete_distribution<point_idx_t> weighted_dist(weights.begin(), weights.end());
+        const auto dist = [&]() { return weights.empty() ? uniform_dist(engine_) : weighted_dist(engine_); };
+
+        {
+            point_vector_t sample(std::min(point_count, std::max(batch_size, std::size_t(cluster_count) * 10)));
+
+            for (auto& point : sample)
+                point = points[dist()];
+
+            cluster_centers = init_centers(sample, weight_vector_t(), cluster_count, init);
+        }
+
+        std::vector<std::size_t> cluster_sizes(cluster_count);
+        std::vector<point_idx_t> batch(batch_size);
+        std::vector<cluster_idx_t> batch_clusters(batch_size);
+        std::vector<distance_t> batch_costs(batch_size);
+
+        for (std::size_t iter = 0; iter < iterations; ++iter)
+        {
+            for (auto& point : batch)
+                point = dist();
+
+#pragma omp parallel for
+            for (std::int64_t i = 0; i < static_cast<std::int64_t>(batch_size); ++i)
+            {
+                batch_costs[i] = std::numeric_limits<distance_t>::max();
+                update_cost(points[batch[i]], cluster_centers, 0, &batch_costs[i], &batch_clusters[i]);
+            }
+
+            // gradient steps are applied in batch order so results do not depend on the thread count
+            for (std::size_t i = 0; i < batch_size; ++i)
+            {
+                auto& center = cluster_centers[batch_clusters[i]];
+                const auto& point = points[batch[i]];
+                const auto rate = 1.0 / ++cluster_sizes[batch_clusters[i]];
+
+                for (dim_idx_t dim = 0; dim < static_cast<dim_idx_t>(center.size()); ++dim)
+                {
+                    center[dim] = static_cast<typename center_t::value_type>(
+                        center[dim] + rate * (point[dim] - center[dim]));
+                }
+            }
+        }
+
+        if (!assign_all)
+        {
+            point_clusters_out->clear();
+            const auto total_weight = weights.empty() ? point_count
+                : std::accumulate(weights.begin(), weights.end(), std::size_t());
+
+            return std::accumulate(batch_costs.begin(), batch_costs.end(), distance_t()) / batch_size * total_weight;
+        }
+
+        auto& point_clusters = *point_clusters_out;
+        point_clusters.resize(point_count);
+
+        const auto blocks = (point_count + detail::BLOCK_SIZE - 1) / detail::BLOCK_SIZE;
+        std::vector<distance_t> block_costs(blocks);
+
+#pragma omp parallel for
+        for (std::int64_t block = 0; block < static_cast<std::int64_t>(blocks); ++block)
+        {
+            const auto end = std::min((block + 1) * detail::BLOCK_SIZE, point_count);
+            distance_t sum = 0;
+
+            for (point_idx_t point = block * detail::BLOCK_SIZE; point < end; ++point)
+            {
+                distance_t cost = std::numeric_limits<distance_t>::max();
+                update_cost(points[point], cluster_centers, 0, &cost, &point_clusters[point]);
+                sum += cost * detail::get_weight(weights, point);
+            }
+
+            block_costs[block] = sum;
+        }
+
+        return std::accumulate(block_costs.begin(), block_costs.end(), distance_t());
+    }
+
+private:
+    const center_vector_t init_centers(const point_vector_t& points, const weight_vector_t& weights,
+        const cluster_idx_t cluster_count, const init_type init)
+    {
         const std::size_t max_init_rounds = 5;
         const double oversampling_factor = 0.5 * cluster_count;
 
         switch (init)
         {
         case PP:
-            cluster_centers = init_k_means_pp(points, cluster_count);
-            break;
+            return init_k_means_pp(points, cluster_count, weights);
         case PARALLEL:
-            cluster_centers = init_k_means_parallel(points, cluster_count, max_init_rounds, oversampling_factor);
-            break;
+            return init_k_means_parallel(points, weights, cluster_count, max_init_rounds, oversampling_factor);
         case OPTIMAL:
-            cluster_centers = (cluster_count < 5 || (cluster_count < 20 && points.size() < 10000))
-                ? init_k_means_pp(points, cluster_count)
-                : init_k_means_parallel(points, cluster_count, max_init_rounds, oversampling_factor);
-            break;
+            return (cluster_count < 5 || (cluster_count < 20 && points.size() < 10000))
+                ? init_k_means_pp(points, cluster_count, weights)
+                : init_k_means_parallel(points, weights, cluster_count, max_init_rounds, oversampling_factor);
         default:
-            cluster_centers = init_random(points, cluster_count);
-            break;
+            return init_random(points, cluster_count);
         }
+    }
+
+    // Hamerly's algorithm: one upper bound and a single lower bound to the second closest center per point
+    static void iterate_hamerly(const point_vector_t& points, const weight_vector_t& weights,
+        const std::size_t max_iterations,
+        const distance_t tolerance, center_vector_t* cluster_centers_out, std::vector<cluster_idx_t>* point_clusters_out)
+    {
+        auto& cluster_centers = *cluster_centers_out;
+        auto& point_clusters = *point_clusters_out;
+        const auto cluster_count = static_cast<cluster_idx_t>(cluster_centers.size());
 
-        point_vector_t old_cluster_centers(cluster_count);
-        point_vector_t cluster_point_sums(cluster_count);
+        center_vector_t old_cluster_centers(cluster_count);
+        center_vector_t cluster_point_sums(cluster_count);
         std::vector<cluster_size_t> cluster_sizes(cluster_count);
         std::vector<distance_t> cluster_move_distances(cluster_count);
 
         std::vector<distance_t> upper_bounds(points.size());
         std::vector<distance_t> lower_bounds(points.size());
-        point_clusters.resize(points.size());
 
-        initialize(cluster_centers, points, &cluster_sizes, &cluster_point_sums, &upper_bounds, &lower_bounds, &point_clusters);
+        initialize(cluster_centers, points, weights, &cluster_sizes, &cluster_point_sums, &upper_bounds, &lower_bounds, &point_clusters);
 
         std::vector<distance_t> intercluster_distances(cluster_count);
 
-        const auto point_variance_mean = detail::calculate_variance_mean(points);
+        const auto point_variance_mean = detail::calculate_variance_mean(points, weights);
 
-        for (std::size_t iters = 0; iters < max_iterations; ++iters)
+        // per thread center updates are allocated once and cleared when they are merged
+        struct thread_data_t
         {
-            update_intercluster_distances(cluster_centers, &intercluster_distances);
-
-            const auto threads = omp_get_max_threads();
+            center_vector_t cluster_point_sums;
+            std::vector<cluster_size_t> cluster_sizes;
+        };
 
-            struct thread_data_t
-            {
-                point_vector_t cluster_point_sums;
-                std::vector<cluster_size_t> cluster_sizes;
-            };
+        std::vector<thread_data_t> thread_data(omp_get_max_threads());
 
-            std::vector<thread_data_t> thread_data(threads);
+        for (std::size_t tid = 0; tid < thread_data.size(); ++tid)
+        {
+            thread_data[tid].cluster_point_sums.resize(cluster_count);
+            thread_data[tid].cluster_sizes.resize(cluster_count);
+        }
 
-            for (std::size_t tid = 0; tid < thread_data.size(); ++tid)
-            {
-                thread_data[tid].cluster_point_sums.resize(cluster_count);
-                thread_data[tid].cluster_sizes.resize(cluster_count);
-            }
+        for (std::size_t iters = 0; iters < max_iterations; ++iters)
+        {
+            update_intercluster_distances(cluster_centers, &intercluster_distances);
 
 #pragma omp parallel for
             for (std::int64_t point_idx = 0; point_idx < static_cast<std::int64_t>(points.size()); ++point_idx)
@@ -188,11 +710,12 @@ public:
                         if (point_clusters[point_idx] != old_cluster)
                         {
                             const auto tid = omp_get_thread_num();
+                            const auto weight = detail::get_weight(weights, point_idx);
 
-                            --thread_data[tid].cluster_sizes[old_cluster];
-                            ++thread_data[tid].cluster_sizes[point_clusters[point_idx]];
-                            detail::vector_sub(thread_data[tid].cluster_point_sums[old_cluster], points[point_idx]);
-                            detail::vector_add(thread_data[tid].cluster_point_sums[point_clusters[point_idx]], points[point_idx]);
+                            thread_data[tid].cluster_sizes[old_cluster] -= weight;
+                            thread_data[tid].cluster_sizes[point_clusters[point_idx]] += weight;
+                            detail::vector_sub(thread_data[tid].cluster_point_sums[old_cluster], points[point_idx], weight);
+                            detail::vector_add(thread_data[tid].cluster_point_sums[point_clusters[point_idx]], points[point_idx], weight);
                         }
                     }
                 }
@@ -201,9 +724,13 @@ public:
             for (std::size_t tid = 0; tid < thread_data.size(); ++tid)
             {
                 detail::vector_add(cluster_sizes, thread_data[tid].cluster_sizes);
+                std::fill(thread_data[tid].cluster_sizes.begin(), thread_data[tid].cluster_sizes.end(), 0);
 
                 for (cluster_idx_t i = 0; i < static_cast<cluster_idx_t>(cluster_point_sums.size()); ++i)
+                {
                     detail::vector_add(cluster_point_sums[i], thread_data[tid].cluster_point_sums[i]);
+                    thread_data[tid].cluster_point_sums[i] = center_t();
+                }
             }
 
             move_centers(cluster_point_sums, cluster_sizes, &old_cluster_centers, &cluster_centers, &cluster_move_distances);
@@ -220,20 +747,235 @@ public:
             if (norm_inertia < tolerance)
                 break;
         }
+    }
 
-        std::vector<distance_t> costs(points.size(), std::numeric_limits<distance_t>::max());
+    // Yinyang k-means (Ding et al. 2015): the centers are grouped once by clustering the initial centers, each
+    // point keeps an upper bound to its center and a lower bound per group which is decreased by the largest
+    // movement in the group every iteration; only groups whose bound is below the best distance are scanned
+    void iterate_yinyang(const point_vector_t& points, const weight_vector_t& weights,
+        const std::size_t max_iterations,
+        const distance_t tolerance, center_vector_t* cluster_centers_out, std::vector<cluster_idx_t>* point_clusters_out)
+    {
+        auto& cluster_centers = *cluster_centers_out;
+        auto& point_clusters = *point_clusters_out;
+        const auto cluster_count = static_cast<cluster_idx_t>(cluster_centers.size());
+        const int groups = std::min(static_cast<int>(cluster_count) / YINYANG_GROUP_SIZE, YINYANG_MAX_GROUPS);
+
+        std::vector<int> center_groups;
+        center_vector_t group_means;
+        k_means<center_t, int, distance_fun_t, cost_fun_t, center_t>(HAMERLY, engine_()).run_single(cluster_centers,
+            weight_vector_t(), groups, 5, 0, PP, &center_groups, &group_means);
+
+        std::vector<std::vector<cluster_idx_t>> group_centers(groups);
+
+        for (cluster_idx_t i = 0; i < cluster_count; ++i)
+            group_centers[center_groups[i]].push_back(i);
+
+        center_vector_t old_cluster_centers(cluster_count);
+        center_vector_t cluster_point_sums(cluster_count);
+        std::vector<cluster_size_t> cluster_sizes(cluster_count);
+        std::vector<distance_t> cluster_move_distances(cluster_count);
+        std::vector<distance_t> group_move_distances(groups);
+
+        // group bounds are stored as floats rounded down to keep the memory at groups * 4 bytes per point
+        std::vector<distance_t> upper_bounds(points.size());
+        std::vector<float> lower_bounds(points.size() * groups);
+
+        struct thread_data_t
+        {
+            center_vector_t cluster_point_sums;
+            std::vector<cluster_size_t> cluster_sizes;
+        };
+
+        std::vector<thread_data_t> thread_data(omp_get_max_threads());
+
+        for (std::size_t tid = 0; tid < thread_data.size(); ++tid)
+        {
+            thread_data[tid].cluster_point_sums.resize(cluster_count);
+            thread_data[tid].cluster_sizes.resize(cluster_count);
+        }
 
 #pragma omp parallel for
-        for (std::int64_t point = 0; point < static_cast<std::int64_t>(points.size()); ++point)
-            update_cost(points[point], cluster_centers, 0, &costs[point], &point_clusters[point]);
+        for (std::int64_t point_idx = 0; point_idx < static_cast<std::int64_t>(points.size()); ++point_idx)
+        {
+            std::array<distance_t, YINYANG_MAX_GROUPS> min_distances;
+            std::array<distance_t, YINYANG_MAX_GROUPS> second_distances;
+            std::array<bool, YINYANG_MAX_GROUPS> scanned;
 
-        const auto cost = std::accumulate(costs.begin(), costs.end(), distance_t());
+            std::fill(scanned.begin(), scanned.begin() + groups, true);
+            point_clusters[point_idx] = 0;
+            upper_bounds[point_idx] = std::numeric_limits<distance_t>::max();
 
-        return cost;
+            point_groups(points[point_idx], cluster_centers, group_centers, center_groups, scanned.data(),
+                &min_distances, &second_distances, &lower_bounds[point_idx * groups], &point_clusters[point_idx],
+                &upper_bounds[point_idx]);
+
+            const auto tid = omp_get_thread_num();
+            const auto weight = detail::get_weight(weights, point_idx);
+            thread_data[tid].cluster_sizes[point_clusters[point_idx]] += weight;
+            detail::vector_add(thread_data[tid].cluster_point_sums[point_clusters[point_idx]], points[point_idx],
+                weight);
+        }
+
+        const auto point_variance_mean = detail::calculate_variance_mean(points, weights);
+
+        for (std::size_t iters = 0; iters < max_iterations; ++iters)
+        {
+            for (std::size_t tid = 0; tid < thread_data.size(); ++tid)
+            {
+                detail::vector_add(cluster_sizes, thread_data[tid].cluster_sizes);
+                std::fill(thread_data[tid].cluster_sizes.begin(), thread_data[tid].cluster_sizes.end(), 0);
+
+                for (cluster_idx_t i = 0; i < cluster_count; ++i)
+                {
+                    detail::vector_add(cluster_point_sums[i], thread_data[tid].cluster_point_sums[i]);
+                    thread_data[tid].cluster_point_sums[i] = center_t();
+                }
+            }
+
+            move_centers(cluster_point_sums, cluster_sizes, &old_cluster_centers, &cluster_centers, &cluster_move_distances);
+
+            std::fill(group_move_distances.begin(), group_move_distances.end(), distance_t());
+
+            for (cluster_idx_t i = 0; i < cluster_count; ++i)
+            {
+                auto& d = group_move_distances[center_groups[i]];
+                d = std::max(d, cluster_move_distances[i]);
+            }
+
+            const auto inertia = std::accumulate(cluster_move_distances.begin(), cluster_move_distances.end(),
+                distance_t(), [](const distance_t& a, const distance_t& b)
+                {
+                    return a + b * b;
+                });
+
+            if (inertia / point_variance_mean < tolerance)
+                break;
+
+#pragma omp parallel for
+            for (std::int64_t point_idx = 0; point_idx < static_cast<std::int64_t>(points.size()); ++point_idx)
+            {
+                auto& cluster = point_clusters[point_idx];
+                auto& upper_bound = upper_bounds[point_idx];
+                const auto lower_bound = &lower_bounds[point_idx * groups];
+                distance_t global_lower_bound = std::numeric_limits<distance_t>::max();
+
+                upper_bound += cluster_move_distances[cluster];
+
+                for (int g = 0; g < groups; ++g)
+                {
+                    lower_bound[g] = round_down(lower_bound[g] - group_move_distances[g]);
+                    global_lower_bound = std::min(global_lower_bound, distance_t(lower_bound[g]));
+                }
+
+                if (upper_bound <= global_lower_bound)
+                    continue;
+
+                // use d() as this value is used for things other than relative comparison
+                upper_bound = distance_fun_t()(points[point_idx], cluster_centers[cluster]);
+
+                if (upper_bound <= global_lower_bound)
+                    continue;
+
+                std::array<distance_t, YINYANG_MAX_GROUPS> min_distances;
+                std::array<distance_t, YINYANG_MAX_GROUPS> second_distances;
+                std::array<bool, YINYANG_MAX_GROUPS> scanned;
+
+                for (int g = 0; g < groups; ++g)
+                    scanned[g] = lower_bound[g] < upper_bound;
+
+                const auto old_cluster = cluster;
+
+                point_groups(points[point_idx], cluster_centers, group_centers, center_groups, scanned.data(),
+                    &min_distances, &second_distances, lower_bound, &cluster, &upper_bound);
+
+                if (cluster != old_cluster)
+                {
+                    const auto tid = omp_get_thread_num();
+                    const auto weight = detail::get_weight(weights, point_idx);
+
+                    thread_data[tid].cluster_sizes[old_cluster] -= weight;
+                    thread_data[tid].cluster_sizes[cluster] += weight;
+                    detail::vector_sub(thread_data[tid].cluster_point_sums[old_cluster], points[point_idx], weight);
+                    detail::vector_add(thread_data[tid].cluster_point_sums[cluster], points[point_idx], weight);
+                }
+            }
+        }
     }
 
-private:
-    static void update_cost(const point_t& point, const point_vector_t& cluster_centers,
+    // scans the flagged groups (skipping any whose bound is not below the best distance found so far), updates
+    // the point's center and upper bound and recomputes the lower bounds of the scanned groups; the bound of the
+    // old center's group must also cover the old center if the point moves away from an unscanned group
+    static void point_groups(const point_t& point, const center_vector_t& cluster_centers,
+        const std::vector<std::vector<cluster_idx_t>>& group_centers, const std::vector<int>& center_groups,
+        bool* scanned, std::array<distance_t, YINYANG_MAX_GROUPS>* min_distances_out,
+        std::array<distance_t, YINYANG_MAX_GROUPS>* second_distances_out, float* lower_bound,
+        cluster_idx_t* cluster_out, distance_t* upper_bound_out)
+    {
+        auto& min_distances = *min_distances_out;
+        auto& second_distances = *second_distances_out;
+        const auto old_cluster = *cluster_out;
+        const auto old_distance = *upper_bound_out;
+        const auto groups = static_cast<int>(group_centers.size());
+        auto best_cluster = old_cluster;
+        auto best_distance = old_distance;
+
+        for (int g = 0; g < groups; ++g)
+        {
+            if (!scanned[g] || lower_bound[g] >= best_distance)
+            {
+                scanned[g] = false;
+                continue;
+            }
+
+            min_distances[g] = std::numeric_limits<distance_t>::max();
+            second_distances[g] = std::numeric_limits<distance_t>::max();
+
+            for (const auto cluster : group_centers[g])
+            {
+                const auto d = distance_fun_t()(point, cluster_centers[cluster]);
+
+                if (d < min_distances[g])
+                {
+                    second_distances[g] = min_distances[g];
+                    min_distances[g] = d;
+
+                    if (d < best_distance)
+                    {
+                        best_distance = d;
+                        best_cluster = cluster;
+                    }
+                }
+                else if (d < second_distances[g])
+                {
+                    second_distances[g] = d;
+                }
+            }
+        }
+
+        for (int g = 0; g < groups; ++g)
+        {
+            if (scanned[g])
+                lower_bound[g] = round_down(center_groups[best_cluster] == g ? second_distances[g] : min_distances[g]);
+            else if (best_cluster != old_cluster && center_groups[old_cluster] == g)
+                lower_bound[g] = std::min(lower_bound[g], round_down(old_distance));
+        }
+
+        *cluster_out = best_cluster;
+        *upper_bound_out = best_distance;
+    }
+
+    static float round_down(const distance_t x)
+    {
+        if (x >= std::numeric_limits<float>::max())
+            return std::numeric_limits<float>::max();
+
+        const auto f = static_cast<float>(x);
+        return f > x ? std::nextafter(f, -std::numeric_limits<float>::max()) : f;
+    }
+
+    template<class P>
+    static void update_cost(const P& point, const center_vector_t& cluster_centers,
         const cluster_idx_t new_clusters_idx, distance_t* old_distance, cluster_idx_t* point_cluster)
     {
         auto& distance_min = *old_distance;
@@ -251,34 +993,30 @@ private:
         }
     }
 
-    static const point_vector_t init_random(const point_vector_t& points, const std::size_t cluster_count)
+    const center_vector_t init_random(const point_vector_t& points, const std::size_t cluster_count)
     {
         if (points.size() <= cluster_count)
-            return points;
+            return detail::make_centers<center_t>(points);
 
-        std::random_device rd;
-        std::mt19937 engine(rd());
         std::uniform_int_distribution<point_idx_t> dist(0, points.size() - 1);
-        point_vector_t cluster_centers(cluster_count);
+        center_vector_t cluster_centers(cluster_count);
 
         for (cluster_idx_t i = 0; i < static_cast<cluster_idx_t>(cluster_centers.size()); ++i)
-            cluster_centers[i] = points[dist(engine)];
+            cluster_centers[i] = detail::make_center<center_t>(points[dist(engine_)]);
 
         return cluster_centers;
     }
 
-    static const point_vector_t init_k_means_parallel(const point_vector_t& points, const cluster_idx_t cluster_count,
-        const std::size_t max_rounds, const double oversampling_factor)
+    const center_vector_t init_k_means_parallel(const point_vector_t& points, const weight_vector_t& weights,
+        const cluster_idx_t cluster_count, const std::size_t max_rounds, const double oversampling_factor)
     {
         if (static_cast<cluster_idx_t>(points.size()) <= cluster_count)
-            return points;
+            return detail::make_centers<center_t>(points);
 
-        std::random_device rd;
-        std::mt19937 engine(rd());
         std::uniform_int_distribution<point_idx_t> dist(0, points.size() - 1);
-        point_vector_t cluster_centers;
+        center_vector_t cluster_centers;
 
-        cluster_centers.push_back(points[dist(engine)]);
+        cluster_centers.push_back(detail::make_center<center_t>(points[dist(engine_)]));
 
         // initialize the costs for each point vs the single initial cluster center
         std::vector<distance_t> costs(points.size(), std::numeric_limits<distance_t>::max());
@@ -288,7 +1026,7 @@ private:
         for (std::int64_t point = 0; point < static_cast<std::int64_t>(points.size()); ++point)
             update_cost(points[point], cluster_centers, 0, &costs[point], &point_clusters[point]);
 
-        auto total_cost = std::accumulate(costs.begin(), costs.end(), distance_t());
+        auto total_cost = detail::block_sum(costs, weights);
 
         const std::size_t iterations_todo = static_cast<std::size_t>(std::ceil(std::log(total_cost)));
 
@@ -296,35 +1034,32 @@ private:
             && (i < max_rounds || static_cast<cluster_idx_t>(cluster_centers.size()) < cluster_count)
             && total_cost > 0; ++i)
         {
-            struct thread_data_t
-            {
-                point_vector_t cluster_centers;
-                std::mt19937 engine;
-            };
-
-            std::vector<thread_data_t> thread_data(omp_get_max_threads());
-
-            for (std::size_t tid = 0; tid < thread_data.size(); ++tid)
-                thread_data[tid].engine = std::mt19937(rd());
+            // every point draws from its own counter based stream so the sample does not depend on the thread
+            // count, and candidates are appended in point order
+            const auto round_seed = (std::uint64_t(engine_()) << 32) | engine_();
+            std::vector<std::vector<point_idx_t>> thread_candidates(omp_get_max_threads());
 
 #pragma omp parallel for
             for (std::int64_t point = 0; point < static_cast<std::int64_t>(points.size()); ++point)
             {
-                const auto tid = omp_get_thread_num();
-                const auto prob = oversampling_factor * costs[point] / total_cost;
-                const auto x = std::uniform_real_distribution<distance_t>(0, 1)(thread_data[tid].engine);
+                const auto prob = oversampling_factor * costs[point] * detail::get_weight(weights, point) / total_cost;
+                const auto x = detail::get_uniform(round_seed, point);
 
                 if (x < prob)
-                    thread_data[tid].cluster_centers.push_back(points[point]);
+                    thread_candidates[omp_get_thread_num()].push_back(point);
             }
 
+            std::vector<point_idx_t> candidates;
+
+            for (const auto& c : thread_candidates)
+                candidates.insert(candidates.end(), c.begin(), c.end());
+
+            std::sort(candidates.begin(), candidates.end());
+
             const cluster_idx_t old_cluster_count = static_cast<cluster_idx_t>(cluster_centers.size());
 
-            for (std::size_t tid = 0; tid < thread_data.size(); ++tid)
-            {
-                cluster_centers.insert(cluster_centers.end(), thread_data[tid].cluster_centers.begin(),
-                    thread_data[tid].cluster_centers.end());
-            }
+            for (const auto point : candidates)
+                cluster_centers.push_back(detail::make_center<center_t>(points[point]));
 
             // update costs for all points as per the new cluster center candidates
 #pragma omp parallel for
@@ -332,7 +1067,7 @@ private:
                 update_cost(points[point], cluster_centers, old_cluster_count, &costs[point], &point_clusters[point]);
 
             // update total cost
-            total_cost = std::accumulate(costs.begin(), costs.end(), distance_t());
+            total_cost = detail::block_sum(costs, weights);
         }
 
         if (static_cast<cluster_idx_t>(cluster_centers.size()) <= cluster_count)
@@ -345,7 +1080,7 @@ private:
 
 #pragma omp parallel for
         for (std::int64_t point = 0; point < static_cast<std::int64_t>(points.size()); ++point)
-            ++thread_cluster_weights[omp_get_thread_num()][point_clusters[point]];
+            thread_cluster_weights[omp_get_thread_num()][point_clusters[point]] += detail::get_weight(weights, point);
 
         std::vector<std::size_t> cluster_weights(cluster_centers.size());
 
@@ -355,56 +1090,78 @@ private:
         return init_k_means_pp(cluster_centers, cluster_count, cluster_weights);
     }
 
-    static const point_vector_t init_k_means_pp(const point_vector_t& points, const cluster_idx_t cluster_count,
-        const std::vector<std::size_t> weights = std::vector<std::size_t>())
+    // also used to reduce the k-means|| candidate centers so the input may be either points or centers; the D^2
+    // updates run in parallel over fixed size blocks whose partial sums are combined in order, so the sampled
+    // centers only depend on the seed and not on the thread count
+    template<class PointVector>
+    const center_vector_t init_k_means_pp(const PointVector& points, const cluster_idx_t cluster_count,
+        const weight_vector_t& weights = weight_vector_t())
     {
         if (static_cast<cluster_idx_t>(points.size()) <= cluster_count)
-            return points;
+            return detail::make_centers<center_t>(points);
 
-        std::random_device rd;
-        std::mt19937 engine(rd());
         std::uniform_int_distribution<point_idx_t> dist(0, points.size() - 1);
-        point_vector_t cluster_centers(cluster_count);
+        center_vector_t cluster_centers(cluster_count);
 
         std::vector<distance_t> distances(points.size(), std::numeric_limits<distance_t>::max());
+        const auto blocks = (points.size() + detail::BLOCK_SIZE - 1) / detail::BLOCK_SIZE;
+        std::vector<distance_t> block_sums(blocks);
 
-        cluster_centers[0] = points[dist(engine)];
+        cluster_centers[0] = detail::make_center<center_t>(points[dist(engine_)]);
 
         for (cluster_idx_t cluster = 1; cluster < cluster_count; ++cluster)
         {
-            distance_t sum = 0;
-
-            for (point_idx_t point = 0; point < points.size(); ++point)
+#pragma omp parallel for
+            for (std::int64_t block = 0; block < static_cast<std::int64_t>(blocks); ++block)
             {
-                // k-means++ uses d^2()
-                const distance_t d = cost_fun_t()(points[point], cluster_centers[cluster - 1]) * (weights.empty() ? 1.0 : weights[point]);
+                const auto end = std::min((block + 1) * detail::BLOCK_SIZE, points.size());
+                distance_t sum = 0;
+
+                for (point_idx_t point = block * detail::BLOCK_SIZE; point < end; ++point)
+                {
+                    // k-means++ uses d^2()
+                    const distance_t d = cost_fun_t()(points[point], cluster_centers[cluster - 1])
+                        * detail::get_weight(weights, point);
 
-                if (d < distances[point])
-                    distances[point] = d;
+                    if (d < distances[point])
+                        distances[point] = d;
 
-                sum += distances[point];
+                    sum += distances[point];
+                }
+
+                block_sums[block] = sum;
             }
 
-            sum = std::uniform_real_distribution<distance_t>(0, sum)(engine);
+            std::partial_sum(block_sums.begin(), block_sums.end(), block_sums.begin());
+
+            auto sum = std::uniform_real_distribution<distance_t>(0, block_sums.back())(engine_);
+            const auto block = std::min<std::size_t>(
+                std::upper_bound(block_sums.begin(), block_sums.end(), sum) - block_sums.begin(), blocks - 1);
 
-            for (point_idx_t point = 0; point < points.size(); ++point)
+            if (block > 0)
+                sum -= block_sums[block - 1];
+
+            const auto end = std::min((block + 1) * detail::BLOCK_SIZE, points.size());
+            auto point = block * detail::BLOCK_SIZE;
+
+            // fall back to the last point of the block if rounding leaves sum past the block's total
+            for (; point < end - 1; ++point)
             {
                 const distance_t p = distances[point];
 
                 if (sum < p)
-                {
-                    cluster_centers[cluster] = points[point];
                     break;
-                }
 
                 sum -= p;
             }
+
+            cluster_centers[cluster] = detail::make_center<center_t>(points[point]);
         }
 
         return cluster_centers;
     }
 
-    static void point_all_ctrs(const point_t& point, const point_vector_t& cluster_centers, cluster_idx_t* cluster_idx_out, distance_t* upper_bound, distance_t* lower_bound)
+    static void point_all_ctrs(const point_t& point, const center_vector_t& cluster_centers, cluster_idx_t* cluster_idx_out, distance_t* upper_bound, distance_t* lower_bound)
     {
         auto& cluster_idx = *cluster_idx_out;
         cluster_idx_t second_cluster_idx = static_cast<cluster_idx_t>(-1);
@@ -447,8 +1204,8 @@ private:
         *lower_bound = distance_fun_t()(point, cluster_centers[second_cluster_idx]);
     }
 
-    static void initialize(const point_vector_t& cluster_centers, const point_vector_t& points,
-        std::vector<cluster_size_t>* cluster_sizes_out, point_vector_t* cluster_point_sums_out, std::vector<distance_t>* upper_bounds_out,
+    static void initialize(const center_vector_t& cluster_centers, const point_vector_t& points,
+        const weight_vector_t& weights, std::vector<cluster_size_t>* cluster_sizes_out, center_vector_t* cluster_point_sums_out, std::vector<distance_t>* upper_bounds_out,
         std::vector<distance_t>* lower_bounds_out, std::vector<cluster_idx_t>* point_clusters_out)
     {
         auto& cluster_sizes = *cluster_sizes_out;
@@ -461,7 +1218,7 @@ private:
 
         struct thread_data_t
         {
-            point_vector_t cluster_point_sums;
+            center_vector_t cluster_point_sums;
             std::vector<cluster_size_t> cluster_sizes;
         };
 
@@ -479,8 +1236,9 @@ private:
         {
             point_all_ctrs(points[i], cluster_centers, &point_clusters[i], &upper_bounds[i], &lower_bounds[i]);
             const auto tid = omp_get_thread_num();
-            ++thread_data[tid].cluster_sizes[point_clusters[i]];
-            detail::vector_add(thread_data[tid].cluster_point_sums[point_clusters[i]], points[i]);
+            const auto weight = detail::get_weight(weights, i);
+            thread_data[tid].cluster_sizes[point_clusters[i]] += weight;
+            detail::vector_add(thread_data[tid].cluster_point_sums[point_clusters[i]], points[i], weight);
         }
 
         for (std::size_t tid = 0; tid < thread_data.size(); ++tid)
@@ -492,7 +1250,7 @@ private:
         }
     }
 
-    static void update_intercluster_distances(const point_vector_t& cluster_centers, std::vector<distance_t>* intercluster_distances)
+    static void update_intercluster_distances(const center_vector_t& cluster_centers, std::vector<distance_t>* intercluster_distances)
     {
         std::fill(intercluster_distances->begin(), intercluster_distances->end(), std::numeric_limits<distance_t>::max());
 
@@ -513,8 +1271,8 @@ private:
         }
     }
 
-    static void move_centers(const point_vector_t& cluster_point_sums, const std::vector<cluster_size_t>& cluster_sizes, point_vector_t* old_cluster_centers_out,
-        point_vector_t* cluster_centers_out, std::vector<distance_t>* cluster_move_distances_out)
+    static void move_centers(const center_vector_t& cluster_point_sums, const std::vector<cluster_size_t>& cluster_sizes, center_vector_t* old_cluster_centers_out,
+        center_vector_t* cluster_centers_out, std::vector<distance_t>* cluster_move_distances_out)
     {
         auto& old_cluster_centers = *old_cluster_centers_out;
         auto& cluster_centers = *cluster_centers_out;
@@ -570,4 +1328,8 @@ private:
                 lower_bounds[i] -= first_max_move_distance;
         }
     }
+
+    algorithm_type algorithm_;
+    std::mt19937 engine_;
+    int threads_per_run_;
 };
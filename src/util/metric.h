@@ -1,9 +1,23 @@
 #pragma once
 
-struct get_emd_distance
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include "compact_histogram.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace detail
 {
-    template<class T>
-    double operator()(const T& a, const T& b) const
+    // scalar reference kernels, used for arbitrary point types and when AVX2 is not available
+
+    template<class A, class B>
+    double get_emd_distance(const A& a, const B& b)
     {
         assert(a.size() > 1 && b.size() > 1 && a.size() == b.size());
 
@@ -19,12 +33,281 @@ struct get_emd_distance
 
         return distance;
     }
+
+    template<class A, class B>
+    double get_l2_distance(const A& a, const B& b)
+    {
+        assert(a.size() == b.size());
+
+        double distance = 0;
+
+        for (std::size_t i = 0; i < a.size(); ++i)
+            distance += std::sqrt((a[i] - b[i]) * (a[i] - b[i]));
+
+        return distance;
+    }
+
+    template<class A, class B>
+    double get_l2_cost(const A& a, const B& b)
+    {
+        assert(a.size() == b.size());
+
+        double distance = 0;
+
+        for (std::size_t i = 0; i < a.size(); ++i)
+            distance += (a[i] - b[i]) * (a[i] - b[i]);
+
+        return distance;
+    }
+
+#ifdef __AVX2__
+    // the scalar EMD is faster than the vector prefix scan below this many bins, see metric.DISABLED_kernel_benchmark
+    static const std::size_t EMD_AVX2_MIN_BINS = 12;
+
+    inline double horizontal_sum(const __m256d x)
+    {
+        const __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+    }
+
+    inline __m256d abs_pd(const __m256d x)
+    {
+        return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+    }
+
+    // the kernels read their arguments through lanes which load 4 or 8 elements as floats
+
+    struct float_lanes
+    {
+        const float* p;
+
+        __m128 load4(const std::size_t i) const
+        {
+            return _mm_loadu_ps(p + i);
+        }
+
+        __m256 load8(const std::size_t i) const
+        {
+            return _mm256_loadu_ps(p + i);
+        }
+
+        float operator[](const std::size_t i) const
+        {
+            return p[i];
+        }
+    };
+
+    // the integer counts of a compact histogram are converted in register and multiplied by its scale, which
+    // gives exactly the floats of compact_histogram::operator[] without expanding the point
+    template<class T>
+    struct count_lanes;
+
+    template<>
+    struct count_lanes<std::uint8_t>
+    {
+        const std::uint8_t* p;
+        float scale;
+
+        __m128 load4(const std::size_t i) const
+        {
+            std::int32_t x;
+            std::memcpy(&x, p + i, sizeof(x));
+            return _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(x))), _mm_set1_ps(scale));
+        }
+
+        __m256 load8(const std::size_t i) const
+        {
+            const auto x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + i));
+            return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(x)), _mm256_set1_ps(scale));
+        }
+
+        float operator[](const std::size_t i) const
+        {
+            return p[i] * scale;
+        }
+    };
+
+    template<>
+    struct count_lanes<std::uint16_t>
+    {
+        const std::uint16_t* p;
+        float scale;
+
+        __m128 load4(const std::size_t i) const
+        {
+            const auto x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + i));
+            return _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(x)), _mm_set1_ps(scale));
+        }
+
+        __m256 load8(const std::size_t i) const
+        {
+            const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(x)), _mm256_set1_ps(scale));
+        }
+
+        float operator[](const std::size_t i) const
+        {
+            return p[i] * scale;
+        }
+    };
+
+    template<std::size_t N>
+    float_lanes make_lanes(const std::array<float, N>& a)
+    {
+        return float_lanes{a.data()};
+    }
+
+    template<class T, std::size_t N>
+    count_lanes<T> make_lanes(const compact_histogram<T, N>& a)
+    {
+        return count_lanes<T>{a.get_counts().data(), a.get_scale()};
+    }
+
+    // the running difference of the cumulative distributions is kept in double like the scalar version, four
+    // prefix sums at a time: an in-register inclusive scan plus the carry from the previous block
+    template<std::size_t N, class A, class B>
+    double get_emd_distance_avx2(const A& a, const B& b)
+    {
+        static_assert(N > 1, "EMD requires at least two bins");
+
+        const auto zero = _mm256_setzero_pd();
+        auto carry = zero;
+        auto distance = zero;
+        const std::size_t blocks = (N - 1) / 4 * 4;
+
+        for (std::size_t i = 0; i < blocks; i += 4)
+        {
+            auto x = _mm256_sub_pd(_mm256_cvtps_pd(a.load4(i)), _mm256_cvtps_pd(b.load4(i)));
+            x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x1));
+            x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x3));
+            x = _mm256_add_pd(x, carry);
+            carry = _mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 3, 3, 3));
+            distance = _mm256_add_pd(distance, abs_pd(x));
+        }
+
+        double result = horizontal_sum(distance);
+        double prev = _mm_cvtsd_f64(_mm256_castpd256_pd128(carry));
+
+        for (std::size_t i = blocks; i < N - 1; ++i)
+        {
+            prev += double(a[i]) - b[i];
+            result += std::abs(prev);
+        }
+
+        return result;
+    }
+
+    // per element differences are computed in float exactly like the scalar version and accumulated in double
+    template<std::size_t N, bool Square, class A, class B>
+    double get_l2_avx2(const A& a, const B& b)
+    {
+        auto sum = _mm256_setzero_pd();
+        const std::size_t blocks = N / 8 * 8;
+
+        for (std::size_t i = 0; i < blocks; i += 8)
+        {
+            auto d = _mm256_sub_ps(a.load8(i), b.load8(i));
+            d = Square ? _mm256_mul_ps(d, d) : _mm256_andnot_ps(_mm256_set1_ps(-0.0f), d);
+            sum = _mm256_add_pd(sum, _mm256_cvtps_pd(_mm256_castps256_ps128(d)));
+            sum = _mm256_add_pd(sum, _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1)));
+        }
+
+        double result = horizontal_sum(sum);
+
+        for (std::size_t i = blocks; i < N; ++i)
+        {
+            const float d = a[i] - b[i];
+            result += Square ? d * d : std::abs(d);
+        }
+
+        return result;
+    }
+#endif
+
+    // compact histograms are measured against float centers directly on their counts; count types without an
+    // AVX2 kernel use the scalar kernels, which also compute each element with a single multiply
+
+    template<class T, std::size_t N>
+    double get_compact_emd_distance(const compact_histogram<T, N>& a, const std::array<float, N>& b)
+    {
+        return get_emd_distance(a, b);
+    }
+
+    template<bool Square, class T, std::size_t N>
+    double get_compact_l2(const compact_histogram<T, N>& a, const std::array<float, N>& b)
+    {
+        return Square ? get_l2_cost(a, b) : get_l2_distance(a, b);
+    }
+
+#ifdef __AVX2__
+    template<std::size_t N>
+    double get_compact_emd_distance(const compact_histogram<std::uint8_t, N>& a, const std::array<float, N>& b)
+    {
+        if (N < EMD_AVX2_MIN_BINS)
+            return get_emd_distance(a, b);
+
+        return get_emd_distance_avx2<N>(make_lanes(a), make_lanes(b));
+    }
+
+    template<std::size_t N>
+    double get_compact_emd_distance(const compact_histogram<std::uint16_t, N>& a, const std::array<float, N>& b)
+    {
+        if (N < EMD_AVX2_MIN_BINS)
+            return get_emd_distance(a, b);
+
+        return get_emd_distance_avx2<N>(make_lanes(a), make_lanes(b));
+    }
+
+    template<bool Square, std::size_t N>
+    double get_compact_l2(const compact_histogram<std::uint8_t, N>& a, const std::array<float, N>& b)
+    {
+        return get_l2_avx2<N, Square>(make_lanes(a), make_lanes(b));
+    }
+
+    template<bool Square, std::size_t N>
+    double get_compact_l2(const compact_histogram<std::uint16_t, N>& a, const std::array<float, N>& b)
+    {
+        return get_l2_avx2<N, Square>(make_lanes(a), make_lanes(b));
+    }
+#endif
+}
+
+// The functors pick an AVX2 kernel at compile time when both arguments are float arrays of the same dimension or
+// a compact histogram of uint8 or uint16 counts is measured against a float center, except for EMD on fewer than
+// EMD_AVX2_MIN_BINS bins; everything else uses the scalar kernels.
+
+struct get_emd_distance
+{
+    template<class A, class B>
+    double operator()(const A& a, const B& b) const
+    {
+        return detail::get_emd_distance(a, b);
+    }
+
+    template<class T, std::size_t N>
+    double operator()(const compact_histogram<T, N>& a, const std::array<float, N>& b) const
+    {
+        return detail::get_compact_emd_distance(a, b);
+    }
+
+    template<std::size_t N>
+    double operator()(const std::array<float, N>& a, const std::array<float, N>& b) const
+    {
+#ifdef __AVX2__
+        if (N < detail::EMD_AVX2_MIN_BINS)
+            return detail::get_emd_distance(a, b);
+
+        return detail::get_emd_distance_avx2<N>(detail::make_lanes(a), detail::make_lanes(b));
+#else
+        return detail::get_emd_distance(a, b);
+#endif
+    }
 };
 
 struct get_emd_cost
 {
-    template<class T>
-    double operator()(const T& a, const T& b) const
+    template<class A, class B>
+    double operator()(const A& a, const B& b) const
     {
         const auto val = get_emd_distance()(a, b);
         return val * val;
@@ -33,37 +316,55 @@ struct get_emd_cost
 
 struct get_l2_distance
 {
-    template<class T>
-    double operator()(const T& a, const T& b) const
+    template<class A, class B>
+    double operator()(const A& a, const B& b) const
     {
-        assert(a.size() == b.size());
-
-        double distance = 0;
+        return detail::get_l2_distance(a, b);
+    }
 
-        for (std::size_t i = 0; i < a.size(); ++i)
-            distance += std::sqrt((a[i] - b[i]) * (a[i] - b[i]));
+    template<class T, std::size_t N>
+    double operator()(const compact_histogram<T, N>& a, const std::array<float, N>& b) const
+    {
+        return detail::get_compact_l2<false>(a, b);
+    }
 
-        return distance;
+    template<std::size_t N>
+    double operator()(const std::array<float, N>& a, const std::array<float, N>& b) const
+    {
+#ifdef __AVX2__
+        return detail::get_l2_avx2<N, false>(detail::make_lanes(a), detail::make_lanes(b));
+#else
+        return detail::get_l2_distance(a, b);
+#endif
     }
 };
 
 struct get_l2_cost
 {
-    template<class T>
-    double operator()(const T& a, const T& b) const
+    template<class A, class B>
+    double operator()(const A& a, const B& b) const
     {
-        assert(a.size() == b.size());
-
-        double distance = 0;
+        return detail::get_l2_cost(a, b);
+    }
 
-        for (std::size_t i = 0; i < a.size(); ++i)
-            distance += (a[i] - b[i]) * (a[i] - b[i]);
+    template<class T, std::size_t N>
+    double operator()(const compact_histogram<T, N>& a, const std::array<float, N>& b) const
+    {
+        return detail::get_compact_l2<true>(a, b);
+    }
 
-        return distance;
+    template<std::size_t N>
+    double operator()(const std::array<float, N>& a, const std::array<float, N>& b) const
+    {
+#ifdef __AVX2__
+        return detail::get_l2_avx2<N, true>(detail::make_lanes(a), detail::make_lanes(b));
+#else
+        return detail::get_l2_cost(a, b);
+#endif
     }
 };
 
-std::uint32_t get_hamming_distance(const std::uint32_t x, const std::uint32_t y)
+inline std::uint32_t get_hamming_distance(const std::uint32_t x, const std::uint32_t y)
 {
     std::uint32_t dist = 0;
     auto val = x ^ y;
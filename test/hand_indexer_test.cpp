@@ -0,0 +1,275 @@
+#include <array>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <iostream>
+#include "gtest/gtest.h"
+#include "lutlib/hand_indexer.h"
+
+TEST(hand_indexer, sizes)
+{
+    const hand_indexer preflop(std::vector<card_t>{2});
+    const hand_indexer river(std::vector<card_t>{2, 3, 1, 1});
+
+    EXPECT_EQ(1, preflop.get_rounds());
+    EXPECT_EQ(169u, preflop.get_size(0));
+
+    EXPECT_EQ(4, river.get_rounds());
+    EXPECT_EQ(169u, river.get_size(0));
+    EXPECT_EQ(1286792u, river.get_size(1));
+    EXPECT_EQ(55190538u, river.get_size(2));
+    EXPECT_EQ(2428287420u, river.get_size(3));
+}
+
+TEST(hand_indexer, flop_round_trip)
+{
+    // a second indexer with a different configuration shares the same tables
+    const hand_indexer indexer(std::vector<card_t>{2, 3});
+    const hand_indexer other(std::vector<card_t>{2, 4});
+    std::array<card_t, 7> cards;
+
+    for (hand_indexer::hand_index_t i = 0; i < indexer.get_size(1); ++i)
+    {
+        ASSERT_TRUE(indexer.hand_unindex(1, i, cards.data()));
+        ASSERT_EQ(i, indexer.hand_index_last(cards.data()));
+    }
+
+    for (hand_indexer::hand_index_t i = 0; i < other.get_size(1); i += 997)
+    {
+        ASSERT_TRUE(other.hand_unindex(1, i, cards.data()));
+        ASSERT_EQ(i, other.hand_index_last(cards.data()));
+    }
+}
+
+namespace
+{
+    const std::array<hand_indexer, 4>& get_abstraction_indexers()
+    {
+        // the per-round indexers used by holdem_abstraction
+        static const std::array<hand_indexer, 4> indexers = {{
+            hand_indexer(std::vector<card_t>{2}),
+            hand_indexer(std::vector<card_t>{2, 3}),
+            hand_indexer(std::vector<card_t>{2, 4}),
+            hand_indexer(std::vector<card_t>{2, 5})}};
+
+        return indexers;
+    }
+
+    std::array<card_t, 7> deal(std::mt19937& engine)
+    {
+        std::array<card_t, CARDS> deck;
+        std::iota(deck.begin(), deck.end(), card_t());
+
+        for (int i = 0; i < 7; ++i)
+            std::swap(deck[i], deck[std::uniform_int_distribution<int>(i, CARDS - 1)(engine)]);
+
+        std::array<card_t, 7> cards;
+        std::copy(deck.begin(), deck.begin() + cards.size(), cards.begin());
+        return cards;
+    }
+
+    void index_shared(const std::array<hand_indexer, 4>& indexers, const std::array<card_t, 7>& cards,
+        std::array<hand_indexer::hand_index_t, 4>* indices)
+    {
+        hand_indexer_state_t preflop_state;
+        indexers[0].hand_index_init(&preflop_state);
+        (*indices)[0] = indexers[0].hand_index_next_round(cards.data(), &preflop_state);
+
+        for (std::size_t i = 1; i < indexers.size(); ++i)
+        {
+            auto state = preflop_state;
+            (*indices)[i] = indexers[i].hand_index_next_round(cards.data() + 2, &state);
+        }
+    }
+}
+
+TEST(hand_indexer, shared_preflop_state)
+{
+    const auto& indexers = get_abstraction_indexers();
+    std::mt19937 engine(1);
+
+    for (int i = 0; i < 100000; ++i)
+    {
+        const auto cards = deal(engine);
+        std::array<hand_indexer::hand_index_t, 4> indices;
+        index_shared(indexers, cards, &indices);
+
+        for (std::size_t j = 0; j < indexers.size(); ++j)
+            ASSERT_EQ(indexers[j].hand_index_last(cards.data()), indices[j]);
+    }
+}
+
+// run with --gtest_also_run_disabled_tests
+TEST(hand_indexer, DISABLED_shared_preflop_state_benchmark)
+{
+    const auto& indexers = get_abstraction_indexers();
+    std::mt19937 engine(1);
+    std::vector<std::array<card_t, 7>> deals(1000000);
+
+    for (auto& cards : deals)
+        cards = deal(engine);
+
+    hand_indexer::hand_index_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (const auto& cards : deals)
+    {
+        for (const auto& indexer : indexers)
+            checksum += indexer.hand_index_last(cards.data());
+    }
+
+    const std::chrono::duration<double> separate = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+
+    for (const auto& cards : deals)
+    {
+        std::array<hand_indexer::hand_index_t, 4> indices;
+        index_shared(indexers, cards, &indices);
+        checksum -= std::accumulate(indices.begin(), indices.end(), hand_indexer::hand_index_t());
+    }
+
+    const std::chrono::duration<double> shared = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(0u, checksum);
+    std::cout << "separate: " << deals.size() / separate.count() << " deals/s, shared: "
+        << deals.size() / shared.count() << " deals/s\n";
+}
+
+TEST(hand_indexer, batch)
+{
+    const hand_indexer indexer(std::vector<card_t>{2, 3, 1, 1});
+    std::mt19937 engine(2);
+    std::vector<card_t> hands;
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        const auto cards = deal(engine);
+        hands.insert(hands.end(), cards.begin(), cards.end());
+    }
+
+    const auto count = hands.size() / 7;
+    std::vector<hand_indexer::hand_index_t> indices(count);
+    indexer.hand_index_batch(3, hands.data(), count, indices.data());
+
+    for (std::size_t i = 0; i < count; ++i)
+        EXPECT_EQ(indexer.hand_index_last(&hands[i * 7]), indices[i]);
+
+    // earlier rounds use fewer cards per hand
+    std::vector<card_t> flops;
+
+    for (std::size_t i = 0; i < count; ++i)
+        flops.insert(flops.end(), hands.begin() + i * 7, hands.begin() + i * 7 + 5);
+
+    indexer.hand_index_batch(1, flops.data(), count, indices.data());
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        hand_indexer_state_t state;
+        indexer.hand_index_init(&state);
+        indexer.hand_index_next_round(&flops[i * 5], &state);
+        EXPECT_EQ(indexer.hand_index_next_round(&flops[i * 5 + 2], &state), indices[i]);
+    }
+}
+
+// run with --gtest_also_run_disabled_tests
+TEST(hand_indexer, DISABLED_batch_benchmark)
+{
+    const hand_indexer indexer(std::vector<card_t>{2, 5});
+    std::mt19937 engine(1);
+    std::vector<card_t> hands;
+
+    for (int i = 0; i < 1000000; ++i)
+    {
+        const auto cards = deal(engine);
+        hands.insert(hands.end(), cards.begin(), cards.end());
+    }
+
+    const auto count = hands.size() / 7;
+    std::vector<hand_indexer::hand_index_t> indices(count);
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < count; ++i)
+        indices[i] = indexer.hand_index_last(&hands[i * 7]);
+
+    const std::chrono::duration<double> scalar = std::chrono::steady_clock::now() - start;
+    const auto checksum = std::accumulate(indices.begin(), indices.end(), hand_indexer::hand_index_t());
+    start = std::chrono::steady_clock::now();
+
+    indexer.hand_index_batch(1, hands.data(), count, indices.data());
+
+    const std::chrono::duration<double> batch = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(checksum, std::accumulate(indices.begin(), indices.end(), hand_indexer::hand_index_t()));
+    std::cout << "scalar: " << count / scalar.count() << " hands/s, batch: " << count / batch.count()
+        << " hands/s\n";
+}
+
+TEST(hand_indexer, iterator)
+{
+    const hand_indexer indexer(std::vector<card_t>{2, 3, 1, 1});
+    std::array<card_t, 7> cards;
+
+    // the whole flop round from the start and a chunk starting in the middle of the turn round
+    for (hand_indexer::hand_iterator it(indexer, 1, 0); it.get_index() < indexer.get_size(1); it.next())
+    {
+        ASSERT_TRUE(indexer.hand_unindex(1, it.get_index(), cards.data()));
+        ASSERT_TRUE(std::equal(cards.begin(), cards.begin() + 5, it.get_cards()));
+    }
+
+    const hand_indexer::hand_index_t begin = indexer.get_size(2) / 3;
+
+    for (hand_indexer::hand_iterator it(indexer, 2, begin); it.get_index() < begin + 1000000; it.next())
+    {
+        ASSERT_TRUE(indexer.hand_unindex(2, it.get_index(), cards.data()));
+        ASSERT_TRUE(std::equal(cards.begin(), cards.begin() + 6, it.get_cards()));
+    }
+}
+
+TEST(hand_indexer, for_each_hand)
+{
+    const hand_indexer indexer(std::vector<card_t>{2, 3});
+    std::vector<int> visits(indexer.get_size(1));
+    std::vector<char> matches(visits.size());
+
+    // every index is visited exactly once with its canonical cards
+    indexer.for_each_hand(1, [&](const hand_indexer::hand_index_t index, const card_t* cards)
+    {
+        std::array<card_t, 5> expected;
+        indexer.hand_unindex(1, index, expected.data());
+        ++visits[index];
+        matches[index] = std::equal(expected.begin(), expected.end(), cards);
+    });
+
+    EXPECT_TRUE(std::all_of(visits.begin(), visits.end(), [](const int x) { return x == 1; }));
+    EXPECT_TRUE(std::all_of(matches.begin(), matches.end(), [](const char x) { return x != 0; }));
+}
+
+// run with --gtest_also_run_disabled_tests
+TEST(hand_indexer, DISABLED_iterator_benchmark)
+{
+    const hand_indexer indexer(std::vector<card_t>{2, 5});
+    const hand_indexer::hand_index_t count = 10000000;
+    std::array<card_t, 7> cards;
+    hand_indexer::hand_index_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (hand_indexer::hand_index_t i = 0; i < count; ++i)
+    {
+        indexer.hand_unindex(1, i, cards.data());
+        checksum += std::accumulate(cards.begin(), cards.end(), hand_indexer::hand_index_t());
+    }
+
+    const std::chrono::duration<double> unindex = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+
+    for (hand_indexer::hand_iterator it(indexer, 1, 0); it.get_index() < count; it.next())
+        checksum -= std::accumulate(it.get_cards(), it.get_cards() + 7, hand_indexer::hand_index_t());
+
+    const std::chrono::duration<double> iterator = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(0u, checksum);
+    std::cout << "hand_unindex: " << count / unindex.count() << " hands/s, iterator: "
+        << count / iterator.count() << " hands/s\n";
+}
@@ -0,0 +1,151 @@
+#include <array>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstddef>
+#include "gtest/gtest.h"
+#include "abslib/holdem_abstraction.h"
+#include "util/binary_io.h"
+
+namespace
+{
+    typedef holdem_abstraction::bucket_idx_t bucket_idx_t;
+
+    const holdem_abstraction::bucket_counts_t BUCKET_COUNTS = {{5, 7, 11, 13}};
+
+    const hand_indexer& get_indexer(const int round)
+    {
+        static const hand_indexer preflop(std::vector<card_t>{2});
+        static const hand_indexer flop(std::vector<card_t>{2, 3});
+        static const hand_indexer turn(std::vector<card_t>{2, 4});
+        static const hand_indexer river(std::vector<card_t>{2, 5});
+        static const std::array<const hand_indexer*, holdem_state::ROUNDS> indexers = {{
+            &preflop, &flop, &turn, &river}};
+
+        return *indexers[round];
+    }
+
+    // bucket ids which differ between neighbouring indices of every round
+    std::array<std::vector<bucket_idx_t>, holdem_state::ROUNDS> create_buckets()
+    {
+        std::array<std::vector<bucket_idx_t>, holdem_state::ROUNDS> buckets;
+
+        for (int i = 0; i < holdem_state::ROUNDS; ++i)
+        {
+            const auto& indexer = get_indexer(i);
+            buckets[i].resize(indexer.get_size(indexer.get_rounds() - 1));
+
+            for (std::size_t j = 0; j < buckets[i].size(); ++j)
+                buckets[i][j] = static_cast<bucket_idx_t>(j % BUCKET_COUNTS[i]);
+        }
+
+        return buckets;
+    }
+
+    std::array<const std::vector<bucket_idx_t>*, holdem_state::ROUNDS> get_pointers(
+        const std::array<std::vector<bucket_idx_t>, holdem_state::ROUNDS>& buckets)
+    {
+        return {{&buckets[0], &buckets[1], &buckets[2], &buckets[3]}};
+    }
+
+    // legacy files are [imperfect_recall] followed by [size][int buckets...] for each round
+    void write_legacy(const std::string& filename,
+        const std::array<std::vector<bucket_idx_t>, holdem_state::ROUNDS>& buckets)
+    {
+        auto file = binary_open(filename, "wb");
+        ASSERT_TRUE(file != nullptr);
+        binary_write(*file, true);
+
+        for (const auto& round : buckets)
+        {
+            binary_write(*file, std::uint64_t(round.size()));
+            binary_write(*file, round.data(), round.size());
+        }
+    }
+
+    void check_buckets(const holdem_abstraction& abstraction)
+    {
+        std::mt19937 engine(1);
+        std::array<card_t, 52> deck;
+
+        for (int i = 0; i < 52; ++i)
+            deck[i] = static_cast<card_t>(i);
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            std::shuffle(deck.begin(), deck.end(), engine);
+
+            holdem_abstraction::bucket_type buckets;
+            abstraction.get_buckets(deck[0], deck[1], deck[2], deck[3], deck[4], deck[5], deck[6], &buckets);
+
+            for (int round = 0; round < holdem_state::ROUNDS; ++round)
+            {
+                const auto index = get_indexer(round).hand_index_last(deck.data());
+                ASSERT_EQ(static_cast<bucket_idx_t>(index % BUCKET_COUNTS[round]), buckets[round]);
+            }
+        }
+    }
+}
+
+TEST(holdem_abstraction, read_write_round_trip)
+{
+    const auto buckets = create_buckets();
+
+    // bucket counts up to 2^16 are stored as uint16
+    const std::string filename = "ir-5-7-11-13-v2.abs";
+    holdem_abstraction::write_buckets(filename, true, BUCKET_COUNTS, get_pointers(buckets));
+
+    {
+        holdem_abstraction abstraction;
+        abstraction.read(filename);
+        check_buckets(abstraction);
+    }
+
+    // the header has to match the configuration of the file name
+    const std::string renamed = "pr-5-7-11-13-v2.abs";
+    std::remove(renamed.c_str());
+    ASSERT_EQ(0, std::rename(filename.c_str(), renamed.c_str()));
+    EXPECT_THROW(holdem_abstraction().read(renamed), std::runtime_error);
+    std::remove(renamed.c_str());
+
+    const std::string legacy_filename = "ir-5-7-11-13-legacy.abs";
+    write_legacy(legacy_filename, buckets);
+
+    {
+        holdem_abstraction abstraction;
+        abstraction.read(legacy_filename);
+        check_buckets(abstraction);
+    }
+
+    std::remove(legacy_filename.c_str());
+}
+
+TEST(holdem_abstraction, wrong_round_sizes)
+{
+    auto buckets = create_buckets();
+    buckets[holdem_state::FLOP].pop_back();
+
+    const std::string filename = "ir-5-7-11-13-sizes.abs";
+    EXPECT_THROW(holdem_abstraction::write_buckets(filename, true, BUCKET_COUNTS, get_pointers(buckets)),
+        std::runtime_error);
+
+    // a legacy file with a short flop round
+    write_legacy(filename, buckets);
+    EXPECT_THROW(holdem_abstraction().read(filename), std::runtime_error);
+
+    // a version 2 file whose header records the wrong river size
+    buckets[holdem_state::FLOP].push_back(0);
+    holdem_abstraction::write_buckets(filename, true, BUCKET_COUNTS, get_pointers(buckets));
+
+    {
+        auto file = binary_open(filename, "r+b");
+        ASSERT_TRUE(file != nullptr);
+        ASSERT_EQ(0, std::fseek(file.get(), offsetof(holdem_abstraction::header_type, sizes)
+            + holdem_state::RIVER * sizeof(std::uint64_t), SEEK_SET));
+        binary_write(*file, std::uint64_t(buckets[holdem_state::RIVER].size() - 1));
+    }
+
+    EXPECT_THROW(holdem_abstraction().read(filename), std::runtime_error);
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,55 @@
+#include <limits>
+#include "gtest/gtest.h"
+#include "lutlib/holdem_flop_lut.h"
+#include "lutlib/holdem_turn_lut.h"
+#include "config.h"
+
+namespace
+{
+    std::array<int, 5> get_cards(const std::string& cards)
+    {
+        std::array<int, 5> c;
+
+        for (std::size_t i = 0; i < c.size(); ++i)
+            c[i] = string_to_card(cards.substr(i * 2, 2));
+
+        return c;
+    }
+}
+
+TEST(holdem_flop_lut, turn_lut_means)
+{
+    const holdem_flop_lut lut(std::string(test::TEST_DATA_PATH) + "/holdem_flop_lut.dat");
+    const holdem_turn_lut turn_lut(std::string(test::TEST_DATA_PATH) + "/holdem_turn_lut.dat");
+
+    // quantized tables round the values to multiples of 1 / lut_file::UNIT_SCALE, the means of the turn values
+    // being off by as much as each of them
+    const double rounding = 0.5 / lut_file::UNIT_SCALE + std::numeric_limits<float>::epsilon();
+    const double tolerance = (lut.get_format() == lut_file::LUT_FLOAT ? 0.000001 : rounding)
+        + (turn_lut.get_format() == lut_file::LUT_FLOAT ? 0 : rounding);
+
+    for (const auto& hand : {"9s8dTd5h9h", "AsAdKh7c2d", "7h2c9sTdQh", "5c6cKc4c8d"})
+    {
+        const auto cards = get_cards(hand);
+        double sum = 0;
+        double sum2 = 0;
+
+        for (int turn = 0; turn < 52; ++turn)
+        {
+            if (std::find(cards.begin(), cards.end(), turn) != cards.end())
+                continue;
+
+            const std::array<int, 6> turn_cards = {{cards[0], cards[1], cards[2], cards[3], cards[4], turn}};
+            const auto value = turn_lut.get(turn_cards);
+            sum += value[holdem_turn_lut::EHS];
+            sum2 += value[holdem_turn_lut::EHS2];
+        }
+
+        const auto data = lut.get(cards);
+
+        EXPECT_NEAR(sum / 47, data[holdem_flop_lut::EHS], tolerance) << hand;
+        EXPECT_NEAR(sum2 / 47, data[holdem_flop_lut::EHS2], tolerance) << hand;
+        // the mean of the squared equities is at least the square of the mean equity
+        EXPECT_LE(data[holdem_flop_lut::EHS] * data[holdem_flop_lut::EHS], data[holdem_flop_lut::EHS2] + tolerance);
+    }
+}
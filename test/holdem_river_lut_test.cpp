@@ -1,33 +1,76 @@
+#include <memory>
+#include <vector>
+#include <algorithm>
 #include "gtest/gtest.h"
 #include "lutlib/holdem_river_lut.h"
+#include "lutlib/lut_parts.h"
+#include "evallib/holdem_evaluator.h"
 #include "config.h"
+#include "lut_test_util.h"
 
-namespace
+TEST(holdem_river_lut, known_values)
 {
-    std::array<int, 7> get_cards(const std::string& cards)
-    {
-        std::array<int, 7> c = {{
-            string_to_card(cards.substr(0, 2)),
-            string_to_card(cards.substr(2, 2)),
-            string_to_card(cards.substr(4, 2)),
-            string_to_card(cards.substr(6, 2)),
-            string_to_card(cards.substr(8, 2)),
-            string_to_card(cards.substr(10, 2)),
-            string_to_card(cards.substr(12, 2))
-        }};
-
-        return c;
-    }
+    holdem_river_lut lut(std::string(test::TEST_DATA_PATH) + "/holdem_river_lut.dat");
+
+    EXPECT_NEAR(0.84545, lut.get(test::get_river_cards("9s8dTd5h9hKd8h")), 0.00001);
+    EXPECT_NEAR(0.67677, lut.get(test::get_river_cards("Th4d6d5d7sTdQh")), 0.00001);
+    EXPECT_NEAR(0.71616, lut.get(test::get_river_cards("Kd9h5h6hKhAc7c")), 0.00001);
+    EXPECT_NEAR(0.91212, lut.get(test::get_river_cards("Qd5d5c7hKd8cQh")), 0.00001);
+    EXPECT_NEAR(1.00000, lut.get(test::get_river_cards("JdJsThJc6cJhAc")), 0.00001);
+    EXPECT_NEAR(0.00000, lut.get(test::get_river_cards("2d2s3c3d3h3s2c")), 0.00001);
 }
 
-TEST(holdem_river_lut, known_values)
+TEST(holdem_river_lut, create_boards_matches_enumeration)
 {
-    holdem_river_lut lut(std::string(test::TEST_DATA_PATH) + "/holdem_river_lut.dat");
+    const auto ranks_filename = std::string(test::TEST_DATA_PATH) + "/ranks.dat";
+    std::unique_ptr<holdem_evaluator> eval(new holdem_evaluator(ranks_filename));
 
-    EXPECT_NEAR(0.84545, lut.get(get_cards("9s8dTd5h9hKd8h")), 0.00001);
-    EXPECT_NEAR(0.67677, lut.get(get_cards("Th4d6d5d7sTdQh")), 0.00001);
-    EXPECT_NEAR(0.71616, lut.get(get_cards("Kd9h5h6hKhAc7c")), 0.00001);
-    EXPECT_NEAR(0.91212, lut.get(get_cards("Qd5d5c7hKd8cQh")), 0.00001);
-    EXPECT_NEAR(1.00000, lut.get(get_cards("JdJsThJc6cJhAc")), 0.00001);
-    EXPECT_NEAR(0.00000, lut.get(get_cards("2d2s3c3d3h3s2c")), 0.00001);
+    std::vector<card_t> cfg;
+    cfg.push_back(2);
+    cfg.push_back(5);
+    const hand_indexer indexer(cfg);
+
+    for (const auto board_index : {std::int64_t(0), test::find_board(test::is_paired),
+        test::find_board(test::is_monotone)})
+    {
+        std::vector<holdem_river_lut::index_t> indices;
+        std::vector<holdem_river_lut::data_type> values;
+
+        holdem_river_lut::create_boards(board_index, board_index + 1, [&](
+            const holdem_river_lut::index_t board_indices[], const holdem_river_lut::data_type board_values[],
+            const std::size_t count)
+        {
+            indices.insert(indices.end(), board_indices, board_indices + count);
+            values.insert(values.end(), board_values, board_values + count);
+        }, ranks_filename);
+
+        std::array<card_t, 7> cards;
+        get_canonical_board(board_index, cards.data() + 2);
+        std::size_t pairs = 0;
+
+        for (cards[0] = 0; cards[0] < CARDS; ++cards[0])
+        {
+            for (cards[1] = cards[0] + 1; cards[1] < CARDS; ++cards[1])
+            {
+                if (std::find(cards.begin() + 2, cards.end(), cards[0]) != cards.end()
+                    || std::find(cards.begin() + 2, cards.end(), cards[1]) != cards.end())
+                {
+                    continue;
+                }
+
+                const auto it = std::lower_bound(indices.begin(), indices.end(), indexer.hand_index_last(cards.data()));
+                ASSERT_TRUE(it != indices.end() && *it == indexer.hand_index_last(cards.data()));
+
+                // the counts are the same as enumerate_river's so the equities are identical after rounding to float
+                const auto expected = holdem_river_lut::data_type(eval->enumerate_river(cards[0], cards[1], cards[2],
+                    cards[3], cards[4], cards[5], cards[6]));
+                EXPECT_EQ(expected, values[it - indices.begin()])
+                    << get_card_string(cards[0]) << get_card_string(cards[1]) << " on board " << board_index;
+
+                ++pairs;
+            }
+        }
+
+        EXPECT_EQ(std::size_t((CARDS - 5) * (CARDS - 6) / 2), pairs);
+    }
 }
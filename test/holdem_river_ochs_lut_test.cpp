@@ -1,22 +1,50 @@
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <algorithm>
 #include "gtest/gtest.h"
 #include "lutlib/holdem_river_ochs_lut.h"
+#include "lutlib/lut_parts.h"
+#include "evallib/holdem_evaluator.h"
 #include "config.h"
+#include "lut_test_util.h"
 
 namespace
 {
-    std::array<int, 7> get_cards(const std::string& cards)
+    // win rates of the hand against each opponent cluster, enumerating the opponent hands one by one
+    holdem_river_ochs_lut::data_type enumerate_clusters(const holdem_evaluator& e, const card_t cards[])
     {
-        std::array<int, 7> c = {{
-            string_to_card(cards.substr(0, 2)),
-            string_to_card(cards.substr(2, 2)),
-            string_to_card(cards.substr(4, 2)),
-            string_to_card(cards.substr(6, 2)),
-            string_to_card(cards.substr(8, 2)),
-            string_to_card(cards.substr(10, 2)),
-            string_to_card(cards.substr(12, 2))
-        }};
-
-        return c;
+        const int value = e.get_hand_value(cards[0], cards[1], cards[2], cards[3], cards[4], cards[5], cards[6]);
+        std::array<int, 8> wins = {{}}, ties = {{}}, showdowns = {{}};
+
+        for (card_t o0 = 0; o0 < CARDS; ++o0)
+        {
+            if (std::find(cards, cards + 7, o0) != cards + 7)
+                continue;
+
+            for (card_t o1 = o0 + 1; o1 < CARDS; ++o1)
+            {
+                if (std::find(cards, cards + 7, o1) != cards + 7)
+                    continue;
+
+                const int cluster = holdem_river_ochs_lut::get_pair_cluster(o0, o1);
+                const int opponent = e.get_hand_value(o0, o1, cards[2], cards[3], cards[4], cards[5], cards[6]);
+
+                if (value > opponent)
+                    ++wins[cluster];
+                else if (value == opponent)
+                    ++ties[cluster];
+
+                ++showdowns[cluster];
+            }
+        }
+
+        holdem_river_ochs_lut::data_type data;
+
+        for (std::size_t c = 0; c < data.size(); ++c)
+            data[c] = float(wins[c] + 0.5f * ties[c]) / float(showdowns[c]);
+
+        return data;
     }
 }
 
@@ -24,7 +52,7 @@ TEST(holdem_river_ochs_lut, known_values)
 {
     holdem_river_ochs_lut lut(std::string(test::TEST_DATA_PATH) + "/holdem_river_ochs_lut.dat");
 
-    auto data = lut.get_data(get_cards("Tc8d3h4hTh2s3s"));
+    auto data = lut.get_data(test::get_river_cards("Tc8d3h4hTh2s3s"));
 
     EXPECT_NEAR(0.59420, data[0], 0.00001);
     EXPECT_NEAR(0.78947, data[1], 0.00001);
@@ -35,7 +63,7 @@ TEST(holdem_river_ochs_lut, known_values)
     EXPECT_NEAR(0.80142, data[6], 0.00001);
     EXPECT_NEAR(0.26471, data[7], 0.00001);
 
-    data = lut.get_data(get_cards("Jc2d5h9hQh2s3s"));
+    data = lut.get_data(test::get_river_cards("Jc2d5h9hQh2s3s"));
 
     EXPECT_NEAR(0.26897, data[0], 0.00001);
     EXPECT_NEAR(0.32143, data[1], 0.00001);
@@ -46,7 +74,7 @@ TEST(holdem_river_ochs_lut, known_values)
     EXPECT_NEAR(0.53676, data[6], 0.00001);
     EXPECT_NEAR(0.00000, data[7], 0.00001);
 
-    data = lut.get_data(get_cards("8c7d2h3h4h2s4s"));
+    data = lut.get_data(test::get_river_cards("8c7d2h3h4h2s4s"));
 
     EXPECT_NEAR(0.00000, data[0], 0.00001);
     EXPECT_NEAR(0.11441, data[1], 0.00001);
@@ -57,3 +85,59 @@ TEST(holdem_river_ochs_lut, known_values)
     EXPECT_NEAR(0.00000, data[6], 0.00001);
     EXPECT_NEAR(0.00000, data[7], 0.00001);
 }
+
+TEST(holdem_river_ochs_lut, create_boards_matches_enumeration)
+{
+    const auto ranks_filename = std::string(test::TEST_DATA_PATH) + "/ranks.dat";
+    std::unique_ptr<holdem_evaluator> eval(new holdem_evaluator(ranks_filename));
+
+    std::vector<card_t> cfg;
+    cfg.push_back(2);
+    cfg.push_back(5);
+    const hand_indexer indexer(cfg);
+
+    for (const auto board_index : {std::int64_t(0), test::find_board(test::is_paired),
+        test::find_board(test::is_monotone)})
+    {
+        std::vector<holdem_river_ochs_lut::index_t> indices;
+        std::vector<holdem_river_ochs_lut::data_type> values;
+
+        holdem_river_ochs_lut::create_boards(board_index, board_index + 1, [&](
+            const holdem_river_ochs_lut::index_t board_indices[], const holdem_river_ochs_lut::data_type board_values[],
+            const std::size_t count)
+        {
+            indices.insert(indices.end(), board_indices, board_indices + count);
+            values.insert(values.end(), board_values, board_values + count);
+        }, ranks_filename);
+
+        std::array<card_t, 7> cards;
+        get_canonical_board(board_index, cards.data() + 2);
+        std::size_t pairs = 0;
+
+        for (cards[0] = 0; cards[0] < CARDS; ++cards[0])
+        {
+            for (cards[1] = cards[0] + 1; cards[1] < CARDS; ++cards[1])
+            {
+                if (std::find(cards.begin() + 2, cards.end(), cards[0]) != cards.end()
+                    || std::find(cards.begin() + 2, cards.end(), cards[1]) != cards.end())
+                {
+                    continue;
+                }
+
+                const auto it = std::lower_bound(indices.begin(), indices.end(), indexer.hand_index_last(cards.data()));
+                ASSERT_TRUE(it != indices.end() && *it == indexer.hand_index_last(cards.data()));
+
+                const auto expected = enumerate_clusters(*eval, cards.data());
+                const auto& actual = values[it - indices.begin()];
+
+                // the sweep has to reproduce the enumerated win rates bit for bit
+                EXPECT_EQ(0, std::memcmp(expected.data(), actual.data(), sizeof(expected)))
+                    << get_card_string(cards[0]) << get_card_string(cards[1]) << " on board " << board_index;
+
+                ++pairs;
+            }
+        }
+
+        EXPECT_EQ(std::size_t((CARDS - 5) * (CARDS - 6) / 2), pairs);
+    }
+}
@@ -0,0 +1,52 @@
+#include <limits>
+#include "gtest/gtest.h"
+#include "lutlib/holdem_turn_lut.h"
+#include "lutlib/holdem_river_lut.h"
+#include "config.h"
+
+namespace
+{
+    std::array<int, 6> get_cards(const std::string& cards)
+    {
+        std::array<int, 6> c;
+
+        for (std::size_t i = 0; i < c.size(); ++i)
+            c[i] = string_to_card(cards.substr(i * 2, 2));
+
+        return c;
+    }
+}
+
+TEST(holdem_turn_lut, river_lut_means)
+{
+    const holdem_turn_lut lut(std::string(test::TEST_DATA_PATH) + "/holdem_turn_lut.dat");
+    const holdem_river_lut river_lut(std::string(test::TEST_DATA_PATH) + "/holdem_river_lut.dat");
+
+    // quantized tables round the values to multiples of 1 / lut_file::UNIT_SCALE
+    const double tolerance = lut.get_format() == lut_file::LUT_FLOAT ? 0.000001
+        : 0.5 / lut_file::UNIT_SCALE + std::numeric_limits<float>::epsilon();
+
+    for (const auto& hand : {"9s8dTd5h9hKd", "Th4d6d5d7sTd", "JdJsThJc6cJh", "2d2s3c3d3h3s"})
+    {
+        const auto cards = get_cards(hand);
+        double sum = 0;
+        double sum2 = 0;
+
+        for (int river = 0; river < 52; ++river)
+        {
+            if (std::find(cards.begin(), cards.end(), river) != cards.end())
+                continue;
+
+            const std::array<int, 7> river_cards = {{cards[0], cards[1], cards[2], cards[3], cards[4], cards[5],
+                river}};
+            const double value = river_lut.get(river_cards);
+            sum += value;
+            sum2 += value * value;
+        }
+
+        const auto data = lut.get(cards);
+
+        EXPECT_NEAR(sum / 46, data[holdem_turn_lut::EHS], tolerance) << hand;
+        EXPECT_NEAR(sum2 / 46, data[holdem_turn_lut::EHS2], tolerance) << hand;
+    }
+}
@@ -0,0 +1,383 @@
+#include <array>
+#include <vector>
+#include <numeric>
+#include <limits>
+#include <cmath>
+#include <omp.h>
+#include "gtest/gtest.h"
+#include "util/k_means.h"
+#include "util/metric.h"
+#include "util/compact_histogram.h"
+
+namespace
+{
+    static const std::size_t BINS = 10;
+
+    typedef compact_histogram<std::uint8_t, BINS> compact_point_t;
+    typedef std::array<float, BINS> center_t;
+
+    // three groups of histograms with most of their mass in the first, middle and last bins
+    std::vector<compact_point_t> create_points()
+    {
+        std::vector<compact_point_t> points;
+
+        for (int group = 0; group < 3; ++group)
+        {
+            for (int i = 0; i < 100; ++i)
+            {
+                std::array<std::uint8_t, BINS> counts = {};
+                counts[group * 4 + (i % 2)] = static_cast<std::uint8_t>(40 + i % 7);
+                counts[(group * 4 + 2 + i % 3) % BINS] = static_cast<std::uint8_t>(1 + i % 5);
+                points.push_back(compact_point_t(counts));
+            }
+        }
+
+        return points;
+    }
+}
+
+TEST(k_means, compact_histogram_values)
+{
+    const std::array<std::uint8_t, 4> counts = {{10, 0, 30, 6}};
+    const compact_histogram<std::uint8_t, 4> h(counts);
+
+    EXPECT_EQ(4u, h.size());
+    EXPECT_FLOAT_EQ(10 / 46.0f, h[0]);
+    EXPECT_FLOAT_EQ(0, h[1]);
+    EXPECT_FLOAT_EQ(30 / 46.0f, h[2]);
+    EXPECT_FLOAT_EQ(6 / 46.0f, h[3]);
+}
+
+TEST(k_means, compact_distance_matches_float)
+{
+    const auto points = create_points();
+
+    for (std::size_t i = 0; i < points.size(); i += 7)
+    {
+        const auto a = detail::make_center<center_t>(points[i]);
+        const auto b = detail::make_center<center_t>(points[points.size() - i - 1]);
+
+        EXPECT_NEAR(get_emd_distance()(a, b), get_emd_distance()(points[i], b), 1e-6);
+        EXPECT_NEAR(get_l2_cost()(a, b), get_l2_cost()(points[i], b), 1e-6);
+    }
+}
+
+template<class T>
+void test_compact_kernels()
+{
+    // 50 bins cover both the vector blocks and the scalar tails of the kernels
+    static const std::size_t N = 50;
+    typedef std::array<float, N> float_point_t;
+
+    for (int seed = 0; seed < 20; ++seed)
+    {
+        std::array<T, N> counts_a = {}, counts_b = {};
+
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            counts_a[i] = static_cast<T>((seed * 31 + i * 17) % 23 + (i % 5 == 0 ? 200 : 0));
+            counts_b[i] = static_cast<T>((seed * 7 + i * 13) % 19);
+        }
+
+        const compact_histogram<T, N> a(counts_a);
+        const auto b = detail::make_center<float_point_t>(compact_histogram<T, N>(counts_b));
+        const auto a_float = detail::make_center<float_point_t>(a);
+
+        EXPECT_DOUBLE_EQ(get_emd_distance()(a_float, b), get_emd_distance()(a, b));
+        EXPECT_DOUBLE_EQ(get_emd_cost()(a_float, b), get_emd_cost()(a, b));
+        // the scale multiply may be fused with the subtraction, which skips one float rounding per element
+        const auto l2_distance = get_l2_distance()(a_float, b);
+        const auto l2_cost = get_l2_cost()(a_float, b);
+        EXPECT_NEAR(l2_distance, get_l2_distance()(a, b), l2_distance * 1e-6);
+        EXPECT_NEAR(l2_cost, get_l2_cost()(a, b), l2_cost * 1e-6);
+    }
+}
+
+TEST(k_means, compact_kernels_match_float)
+{
+    test_compact_kernels<std::uint8_t>();
+    test_compact_kernels<std::uint16_t>();
+}
+
+TEST(k_means, compact_points)
+{
+    const auto points = create_points();
+    std::vector<int> clusters;
+    std::vector<center_t> centers;
+
+    k_means<compact_point_t, int, get_emd_distance, get_emd_cost, center_t>().run(points, 3, 100, 0, PP, 3,
+        &clusters, &centers);
+
+    ASSERT_EQ(points.size(), clusters.size());
+    ASSERT_EQ(3u, centers.size());
+
+    for (std::size_t i = 0; i < points.size(); ++i)
+        EXPECT_EQ(clusters[i / 100 * 100], clusters[i]);
+
+    EXPECT_NE(clusters[0], clusters[100]);
+    EXPECT_NE(clusters[0], clusters[200]);
+    EXPECT_NE(clusters[100], clusters[200]);
+
+    for (const auto& center : centers)
+        EXPECT_NEAR(1.0, std::accumulate(center.begin(), center.end(), 0.0), 1e-5);
+}
+
+TEST(k_means, yinyang)
+{
+    // 40 well separated groups so that k-means++ seeding practically always finds the optimal partition
+    std::vector<center_t> points;
+    std::mt19937 engine(1);
+    std::uniform_real_distribution<float> noise(0, 0.00001f);
+
+    for (int group = 0; group < 40; ++group)
+    {
+        for (int i = 0; i < 25; ++i)
+        {
+            center_t p = {};
+            p[group % BINS] = 1.0f - group / BINS * 0.2f;
+            p[(group + 1) % BINS] = group / BINS * 0.2f;
+
+            for (auto& x : p)
+                x += noise(engine);
+
+            const auto sum = std::accumulate(p.begin(), p.end(), 0.0f);
+
+            for (auto& x : p)
+                x /= sum;
+
+            points.push_back(p);
+        }
+    }
+
+    std::vector<int> clusters;
+    std::vector<center_t> centers;
+
+    k_means<center_t, int, get_emd_distance, get_emd_cost>(YINYANG).run(points, 40, 100, 0, PP, 10, &clusters,
+        &centers);
+
+    ASSERT_EQ(points.size(), clusters.size());
+
+    for (std::size_t i = 0; i < points.size(); ++i)
+    {
+        EXPECT_EQ(clusters[i / 25 * 25], clusters[i]);
+        EXPECT_NEAR(0, get_emd_distance()(points[i], centers[clusters[i]]), 0.001);
+    }
+}
+
+TEST(k_means, seeding_independent_of_thread_count)
+{
+    std::vector<center_t> points;
+    std::mt19937 engine(2);
+    std::uniform_real_distribution<float> dist(0, 1);
+
+    for (int i = 0; i < 20000; ++i)
+    {
+        center_t p;
+
+        for (auto& x : p)
+            x = dist(engine);
+
+        points.push_back(p);
+    }
+
+    const auto threads = omp_get_max_threads();
+
+    for (const auto init : {PP, PARALLEL})
+    {
+        std::vector<std::vector<center_t>> centers(2);
+        std::vector<int> clusters;
+
+        for (std::size_t i = 0; i < centers.size(); ++i)
+        {
+            omp_set_num_threads(i == 0 ? 1 : 4);
+            k_means<center_t, int, get_l2_distance, get_l2_cost>(HAMERLY, 42).run(points, 50, 0, 0, init, 1,
+                &clusters, &centers[i]);
+        }
+
+        omp_set_num_threads(threads);
+
+        EXPECT_EQ(centers[0], centers[1]);
+    }
+}
+
+TEST(k_means, mini_batch)
+{
+    std::vector<center_t> points;
+    std::mt19937 engine(3);
+    std::uniform_real_distribution<float> noise(0, 0.01f);
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        center_t p = {};
+        p[i % 5 * 2] = 1.0f;
+
+        for (auto& x : p)
+            x += noise(engine);
+
+        points.push_back(p);
+    }
+
+    typedef k_means<center_t, int, get_l2_distance, get_l2_cost> k_means_t;
+
+    std::vector<int> clusters;
+    std::vector<center_t> centers;
+    const auto cost = k_means_t(HAMERLY, 7).run_mini_batch(points.data(), points.size(), 5, 100, 50, PP, true,
+        &clusters, &centers);
+
+    ASSERT_EQ(points.size(), clusters.size());
+    ASSERT_EQ(5u, centers.size());
+
+    for (std::size_t i = 0; i < points.size(); ++i)
+        EXPECT_EQ(clusters[i % 5], clusters[i]);
+
+    std::vector<int> full_clusters;
+    std::vector<center_t> full_centers;
+    const auto full_cost = k_means_t(HAMERLY, 7).run(points, 5, 100, 0, PP, 1, &full_clusters, &full_centers);
+
+    EXPECT_LT(cost, full_cost * 1.05);
+
+    // without the final assignment the cost is extrapolated from the last batch
+    const auto estimate = k_means_t(HAMERLY, 7).run_mini_batch(points.data(), points.size(), 5, 1000, 50, PP, false,
+        &clusters, &centers);
+
+    EXPECT_TRUE(clusters.empty());
+    EXPECT_NEAR(full_cost, estimate, full_cost * 0.2);
+}
+
+TEST(k_means, unique_points)
+{
+    const auto points = create_points();
+    std::vector<compact_point_t> duplicated;
+
+    for (int i = 0; i < 3; ++i)
+        duplicated.insert(duplicated.end(), points.begin(), points.end());
+
+    typedef k_means<compact_point_t, int, get_emd_distance, get_emd_cost, center_t> k_means_t;
+
+    std::vector<compact_point_t> unique_points;
+    k_means_t::weight_vector_t weights;
+    std::vector<std::size_t> unique_indices;
+    k_means_t::make_unique_points(duplicated, &unique_points, &weights, &unique_indices);
+
+    ASSERT_EQ(points.size(), unique_points.size());
+    EXPECT_EQ(duplicated.size(), std::accumulate(weights.begin(), weights.end(), std::size_t()));
+
+    for (std::size_t i = 0; i < duplicated.size(); ++i)
+        EXPECT_EQ(duplicated[i].get_counts(), unique_points[unique_indices[i]].get_counts());
+
+    // unique points are numbered in order of first occurrence
+    for (std::size_t i = 0; i < points.size(); ++i)
+        EXPECT_EQ(i, unique_indices[i]);
+
+    // points generated on the fly give the same result
+    std::vector<compact_point_t> generated_points;
+    k_means_t::weight_vector_t generated_weights;
+    std::vector<std::size_t> generated_indices;
+    k_means_t::make_unique_points_with([&points](const std::size_t i) { return points[i % points.size()]; },
+        duplicated.size(), &generated_points, &generated_weights, &generated_indices);
+
+    ASSERT_EQ(unique_points.size(), generated_points.size());
+    EXPECT_EQ(weights, generated_weights);
+    EXPECT_EQ(unique_indices, generated_indices);
+
+    std::vector<int> clusters;
+    std::vector<center_t> centers;
+    const auto cost = k_means_t().run_unique(duplicated, 3, 100, 0, PP, 3, &clusters, &centers);
+
+    std::vector<int> full_clusters;
+    std::vector<center_t> full_centers;
+    const auto full_cost = k_means_t().run(duplicated, 3, 100, 0, PP, 3, &full_clusters, &full_centers);
+
+    ASSERT_EQ(duplicated.size(), clusters.size());
+    EXPECT_NEAR(full_cost, cost, full_cost * 1e-4);
+
+    for (std::size_t i = 0; i < duplicated.size(); ++i)
+    {
+        EXPECT_EQ(clusters[i / 100 % 3 * 100], clusters[i]);
+        EXPECT_EQ(clusters[i] == clusters[0], full_clusters[i] == full_clusters[0]);
+    }
+}
+
+TEST(k_means, weighted_mini_batch)
+{
+    std::vector<center_t> points;
+    std::mt19937 engine(5);
+    std::uniform_real_distribution<float> noise(0, 0.01f);
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        center_t p = {};
+        p[i % 5 * 2] = 1.0f;
+
+        for (auto& x : p)
+            x += noise(engine);
+
+        // every point appears a varying number of times
+        for (int j = 0; j < i % 3 + 1; ++j)
+            points.push_back(p);
+    }
+
+    typedef k_means<center_t, int, get_l2_distance, get_l2_cost> k_means_t;
+
+    std::vector<center_t> unique_points;
+    k_means_t::weight_vector_t weights;
+    std::vector<std::size_t> unique_indices;
+    k_means_t::make_unique_points(points.data(), points.size(), &unique_points, &weights, &unique_indices);
+
+    ASSERT_EQ(5000u, unique_points.size());
+
+    std::vector<int> clusters;
+    std::vector<center_t> centers;
+    const auto cost = k_means_t(HAMERLY, 7).run_mini_batch(unique_points.data(), unique_points.size(), weights, 5,
+        100, 50, PP, true, &clusters, &centers);
+
+    std::vector<int> full_clusters;
+    std::vector<center_t> full_centers;
+    const auto full_cost = k_means_t(HAMERLY, 7).run(points, 5, 100, 0, PP, 1, &full_clusters, &full_centers);
+
+    // the weighted cost over the unique points is the cost over all points
+    EXPECT_LT(cost, full_cost * 1.05);
+    EXPECT_GT(cost, full_cost * 0.95);
+
+    for (std::size_t i = 0; i < points.size(); ++i)
+        EXPECT_EQ(clusters[unique_indices[i]] == clusters[0], full_clusters[i] == full_clusters[0]);
+}
+
+TEST(k_means, concurrent_runs)
+{
+    std::vector<center_t> points;
+    std::mt19937 engine(4);
+    std::uniform_real_distribution<float> dist(0, 1);
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        center_t p;
+
+        for (auto& x : p)
+            x = dist(engine);
+
+        points.push_back(p);
+    }
+
+    typedef k_means<center_t, int, get_l2_distance, get_l2_cost> k_means_t;
+
+    const auto threads = omp_get_max_threads();
+    std::vector<std::vector<int>> clusters(2);
+    std::vector<std::vector<center_t>> centers(2);
+    std::vector<double> costs(2);
+
+    // with one thread per restart both schedules compute bit identical restarts
+    omp_set_num_threads(1);
+    costs[0] = k_means_t(HAMERLY, 9).run(points, 20, 50, 0, PP, 6, &clusters[0], &centers[0]);
+
+    omp_set_num_threads(4);
+    k_means_t concurrent(HAMERLY, 9);
+    concurrent.set_threads_per_run(1);
+    costs[1] = concurrent.run(points, 20, 50, 0, PP, 6, &clusters[1], &centers[1]);
+
+    omp_set_num_threads(threads);
+
+    EXPECT_EQ(costs[0], costs[1]);
+    EXPECT_EQ(clusters[0], clusters[1]);
+    EXPECT_EQ(centers[0], centers[1]);
+}
@@ -0,0 +1,52 @@
+#include <cstdio>
+#include <random>
+#include "gtest/gtest.h"
+#include "lutlib/lut_file.h"
+
+TEST(lut_file, formats)
+{
+    const std::string filename = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+
+    // a partial last block and blocks with both narrow and full code ranges
+    const std::size_t count = 1000;
+    const int dimensions = 3;
+    std::vector<std::uint16_t> codes(count * dimensions);
+    std::mt19937 engine(1);
+
+    for (std::size_t i = 0; i < codes.size(); ++i)
+    {
+        const auto d = static_cast<int>(i % dimensions);
+        codes[i] = static_cast<std::uint16_t>(d == 0 ? 1000 + engine() % 5 : d == 1 ? engine() % 0x10000 : 7);
+    }
+
+    for (const auto format : {lut_file::LUT_UINT16, lut_file::LUT_PACKED})
+    {
+        lut_file::write_codes(filename, format, codes.data(), count, dimensions);
+
+        const lut_file file(filename, count, dimensions, false);
+        EXPECT_EQ(format, file.get_format());
+        EXPECT_EQ(nullptr, file.get_floats());
+
+        std::array<std::uint16_t, dimensions> entry;
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            file.get_codes(i, entry.data());
+
+            for (int d = 0; d < dimensions; ++d)
+                EXPECT_EQ(codes[i * dimensions + d], entry[d]);
+        }
+
+        EXPECT_THROW(lut_file(filename, count + 1, dimensions, false), std::runtime_error);
+    }
+
+    const std::vector<float> values(count * dimensions, 0.5f);
+    lut_file::write_floats(filename, values.data(), count, dimensions);
+
+    const lut_file file(filename, count, dimensions, false);
+    EXPECT_EQ(lut_file::LUT_FLOAT, file.get_format());
+    EXPECT_EQ(0.5f, file.get_floats()[count * dimensions - 1]);
+    EXPECT_THROW(lut_file(filename, count, dimensions + 1, false), std::runtime_error);
+
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,169 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include "gtest/gtest.h"
+#include "lutlib/lut_parts.h"
+#include "lutlib/lut_file.h"
+
+namespace
+{
+    // a LUT with one entry per canonical board valued by its board index, cheap enough to build in parts. The
+    // duplicate variant writes the entry of board 0 again for board 1 so the entry count still matches
+    template<bool Duplicate>
+    struct board_lut
+    {
+        typedef float data_type;
+        typedef hand_indexer::hand_index_t index_t;
+
+        static void create_boards(const std::int64_t first_board, const std::int64_t last_board,
+            const std::function<void(const index_t indices[], const data_type values[], std::size_t count)>& write)
+        {
+            for (auto i = first_board; i < last_board; ++i)
+            {
+                const auto board = Duplicate && i == 1 ? 0 : i;
+                const auto index = static_cast<index_t>(board);
+                const auto value = static_cast<data_type>(board);
+                write(&index, &value, 1);
+            }
+        }
+
+        static index_t get_size()
+        {
+            return static_cast<index_t>(get_canonical_board_count());
+        }
+
+        static void save(const std::string& filename, const data_type* data, const std::size_t size,
+            lut_file::format_type)
+        {
+            lut_file::write_floats(filename, data, size, 1);
+        }
+    };
+
+    void remove_lut_parts(const std::string& filename, const int parts)
+    {
+        std::remove(filename.c_str());
+        std::remove((filename + ".manifest").c_str());
+
+        for (int i = 0; i < parts; ++i)
+            std::remove(get_lut_part_filename(filename, i).c_str());
+    }
+
+    std::vector<char> read_file(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void write_file(const std::string& filename, const std::vector<char>& data)
+    {
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+}
+
+TEST(lut_parts, manifest)
+{
+    const std::string filename = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    std::remove((filename + ".manifest").c_str());
+
+    EXPECT_THROW(open_lut_manifest(filename, "river", 0), std::runtime_error);
+
+    const auto manifest = open_lut_manifest(filename, "river", 7);
+
+    EXPECT_EQ("river", manifest.lut);
+    EXPECT_EQ(134459, manifest.boards);
+    EXPECT_EQ(7, manifest.parts);
+
+    // resuming uses the existing manifest which has to match the requested build
+    EXPECT_EQ(7, open_lut_manifest(filename, "river", 0).parts);
+    EXPECT_EQ(7, read_lut_manifest(filename).parts);
+    EXPECT_THROW(open_lut_manifest(filename, "river", 8), std::runtime_error);
+    EXPECT_THROW(open_lut_manifest(filename, "river-ochs", 7), std::runtime_error);
+
+    // parts cover all boards without gaps or overlaps
+    std::int64_t next = 0;
+
+    for (int i = 0; i < manifest.parts; ++i)
+    {
+        const auto boards = get_lut_part_boards(manifest, i);
+        EXPECT_EQ(next, boards.first);
+        EXPECT_LT(boards.first, boards.second);
+        next = boards.second;
+        EXPECT_FALSE(is_lut_part_complete(filename, manifest, i, sizeof(float)));
+    }
+
+    EXPECT_EQ(manifest.boards, next);
+    EXPECT_THROW(get_lut_part_boards(manifest, manifest.parts), std::runtime_error);
+}
+
+TEST(lut_parts, resume_and_merge)
+{
+    const std::string filename = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    const int parts = 4;
+    remove_lut_parts(filename, parts);
+
+    const auto manifest = open_lut_manifest(filename, "board", parts);
+
+    for (int i = 0; i < parts; ++i)
+    {
+        create_lut_part<board_lut<false>>(filename, manifest, i);
+        EXPECT_TRUE(is_lut_part_complete(filename, manifest, i, sizeof(float)));
+        EXPECT_FALSE(std::ifstream(get_lut_part_filename(filename, i) + ".lock"));
+    }
+
+    // an interrupted copy of part 1, a missing part 2 and a recognizable value in the complete part 0
+    const auto part1 = get_lut_part_filename(filename, 1);
+    auto data = read_file(part1);
+    data.resize(data.size() - 1);
+    write_file(part1, data);
+    std::remove(get_lut_part_filename(filename, 2).c_str());
+
+    const auto part0 = get_lut_part_filename(filename, 0);
+    data = read_file(part0);
+    const float marker = -1;
+    std::memcpy(&data[sizeof(lut_part_header) + sizeof(hand_indexer::hand_index_t)], &marker, sizeof(marker));
+    write_file(part0, data);
+
+    EXPECT_FALSE(is_lut_part_complete(filename, manifest, 1, sizeof(float)));
+    EXPECT_FALSE(is_lut_part_complete(filename, manifest, 2, sizeof(float)));
+    EXPECT_THROW(merge_lut_parts<board_lut<false>>(filename, manifest, lut_file::LUT_FLOAT), std::runtime_error);
+
+    // resuming regenerates only the parts which aren't complete
+    for (int i = 0; i < parts; ++i)
+        create_lut_part<board_lut<false>>(filename, manifest, i);
+
+    merge_lut_parts<board_lut<false>>(filename, manifest, lut_file::LUT_FLOAT);
+
+    {
+        const auto size = board_lut<false>::get_size();
+        const lut_file file(filename, size, 1, false);
+        const float* values = file.get_floats();
+
+        EXPECT_EQ(marker, values[0]);
+
+        for (std::size_t i = 1; i < size; ++i)
+            ASSERT_EQ(static_cast<float>(i), values[i]);
+    }
+
+    remove_lut_parts(filename, parts);
+}
+
+TEST(lut_parts, merge_rejects_duplicate_indices)
+{
+    const std::string filename = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    const int parts = 2;
+    remove_lut_parts(filename, parts);
+
+    const auto manifest = open_lut_manifest(filename, "board", parts);
+
+    for (int i = 0; i < parts; ++i)
+        create_lut_part<board_lut<true>>(filename, manifest, i);
+
+    // the entry count matches the table size but index 1 is missing
+    EXPECT_THROW(merge_lut_parts<board_lut<true>>(filename, manifest, lut_file::LUT_FLOAT), std::runtime_error);
+    EXPECT_FALSE(std::ifstream(filename));
+
+    remove_lut_parts(filename, parts);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include "lutlib/lut_parts.h"
+#include "util/card.h"
+
+// helpers shared by the river LUT tests
+
+namespace test
+{
+
+inline std::array<int, 7> get_river_cards(const std::string& cards)
+{
+    std::array<int, 7> c = {{
+        string_to_card(cards.substr(0, 2)),
+        string_to_card(cards.substr(2, 2)),
+        string_to_card(cards.substr(4, 2)),
+        string_to_card(cards.substr(6, 2)),
+        string_to_card(cards.substr(8, 2)),
+        string_to_card(cards.substr(10, 2)),
+        string_to_card(cards.substr(12, 2))
+    }};
+
+    return c;
+}
+
+// first canonical board matching the predicate
+inline std::int64_t find_board(bool (*predicate)(const card_t board[]))
+{
+    std::array<card_t, 5> board;
+
+    for (std::int64_t i = 0; i < get_canonical_board_count(); ++i)
+    {
+        get_canonical_board(i, board.data());
+
+        if (predicate(board.data()))
+            return i;
+    }
+
+    throw std::runtime_error("No matching board");
+}
+
+inline bool is_paired(const card_t board[])
+{
+    for (int i = 0; i < 5; ++i)
+    {
+        for (int j = i + 1; j < 5; ++j)
+        {
+            if (get_rank(board[i]) == get_rank(board[j]))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+inline bool is_monotone(const card_t board[])
+{
+    return std::all_of(board, board + 5, [&](const card_t c) { return get_suit(c) == get_suit(board[0]); });
+}
+
+}
@@ -0,0 +1,137 @@
+#include <array>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include "gtest/gtest.h"
+#include "util/metric.h"
+#include "util/compact_histogram.h"
+
+namespace
+{
+    template<std::size_t N>
+    void check_kernels()
+    {
+        std::mt19937 engine(N);
+        std::uniform_real_distribution<float> dist(0, 1);
+
+        for (int i = 0; i < 100; ++i)
+        {
+            std::array<float, N> a;
+            std::array<float, N> b;
+
+            for (std::size_t j = 0; j < N; ++j)
+            {
+                a[j] = dist(engine);
+                b[j] = dist(engine);
+            }
+
+            EXPECT_NEAR(detail::get_emd_distance(a, b), get_emd_distance()(a, b), 1e-9);
+            EXPECT_NEAR(detail::get_l2_distance(a, b), get_l2_distance()(a, b), 1e-6);
+            EXPECT_NEAR(detail::get_l2_cost(a, b), get_l2_cost()(a, b), 1e-9);
+        }
+    }
+
+    // times all distances between points and centers with the given kernel and returns their sum
+    template<class Point, class F>
+    double time_kernel(const std::vector<Point>& points, const std::vector<Point>& centers, F f, double* seconds)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        double sum = 0;
+
+        for (const auto& point : points)
+        {
+            for (const auto& center : centers)
+                sum += f(point, center);
+        }
+
+        const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        *seconds = duration.count();
+        return sum;
+    }
+
+    template<std::size_t N>
+    void benchmark_kernels()
+    {
+        typedef std::array<float, N> point_t;
+
+        std::mt19937 engine(N);
+        std::uniform_real_distribution<float> dist(0, 1);
+        std::vector<point_t> points(20000);
+        std::vector<point_t> centers(100);
+
+        for (auto& p : points)
+            std::generate(p.begin(), p.end(), [&]() { return dist(engine); });
+
+        for (auto& p : centers)
+            std::generate(p.begin(), p.end(), [&]() { return dist(engine); });
+
+        double scalar, vector;
+        const auto scalar_emd = time_kernel(points, centers, [](const point_t& a, const point_t& b)
+            { return detail::get_emd_distance(a, b); }, &scalar);
+#ifdef __AVX2__
+        const auto vector_emd = time_kernel(points, centers, [](const point_t& a, const point_t& b)
+            { return detail::get_emd_distance_avx2<N>(detail::make_lanes(a), detail::make_lanes(b)); }, &vector);
+#else
+        const auto vector_emd = time_kernel(points, centers, get_emd_distance(), &vector);
+#endif
+
+        EXPECT_NEAR(scalar_emd, vector_emd, scalar_emd * 1e-9);
+        std::cout << N << " bins EMD scalar: " << scalar << " s, vector: " << vector << " s ("
+            << scalar / vector << "x)\n";
+
+        const auto scalar_l2 = time_kernel(points, centers, [](const point_t& a, const point_t& b)
+            { return detail::get_l2_cost(a, b); }, &scalar);
+#ifdef __AVX2__
+        const auto vector_l2 = time_kernel(points, centers, [](const point_t& a, const point_t& b)
+            { return detail::get_l2_avx2<N, true>(detail::make_lanes(a), detail::make_lanes(b)); }, &vector);
+#else
+        const auto vector_l2 = time_kernel(points, centers, get_l2_cost(), &vector);
+#endif
+
+        EXPECT_NEAR(scalar_l2, vector_l2, scalar_l2 * 1e-9);
+        std::cout << N << " bins L2 scalar: " << scalar << " s, vector: " << vector << " s ("
+            << scalar / vector << "x)\n";
+    }
+}
+
+TEST(metric, kernels_match_scalar)
+{
+    check_kernels<2>();
+    check_kernels<5>();
+    check_kernels<8>();
+    check_kernels<13>();
+    check_kernels<50>();
+}
+
+TEST(metric, emd_known_values)
+{
+    const std::array<float, 4> a = {{1, 0, 0, 0}};
+    const std::array<float, 4> b = {{0, 0, 0, 1}};
+    const std::array<float, 4> c = {{0, 1, 0, 0}};
+
+    EXPECT_DOUBLE_EQ(3, get_emd_distance()(a, b));
+    EXPECT_DOUBLE_EQ(1, get_emd_distance()(a, c));
+    EXPECT_DOUBLE_EQ(0, get_emd_distance()(b, b));
+}
+
+TEST(metric, compact_point)
+{
+    const std::array<std::uint8_t, 4> counts = {{1, 1, 0, 2}};
+    const compact_histogram<std::uint8_t, 4> a(counts);
+    const std::array<float, 4> b = {{0.25f, 0.25f, 0, 0.5f}};
+    const std::array<float, 4> c = {{0, 0, 0, 1}};
+
+    EXPECT_NEAR(0, get_emd_distance()(a, b), 1e-7);
+    EXPECT_NEAR(detail::get_emd_distance(a, c), get_emd_distance()(a, c), 1e-7);
+    EXPECT_NEAR(detail::get_l2_cost(a, c), get_l2_cost()(a, c), 1e-7);
+}
+
+// run with --gtest_also_run_disabled_tests; compares the scalar kernels with the AVX2 ones, or with the functors
+// if AVX2 is not enabled
+TEST(metric, DISABLED_kernel_benchmark)
+{
+    benchmark_kernels<8>();
+    benchmark_kernels<50>();
+}
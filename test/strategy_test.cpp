@@ -0,0 +1,328 @@
+#include <array>
+#include <omp.h>
+#include "gtest/gtest.h"
+#include "cfrlib/strategy.h"
+#include "cfrlib/strategy_writer.h"
+#include "gamelib/kuhn_state.h"
+#include "util/binary_io.h"
+
+namespace
+{
+    static const int BUCKETS = 3;
+
+    float get_expected(const game_state_base& state, int child, int bucket)
+    {
+        // arbitrary non-uniform distribution which sums to one
+        const int weight = (state.get_id() + child + bucket) % 5 + 1;
+        int sum = 0;
+
+        for (int i = 0; i < state.get_child_count(); ++i)
+            sum += (state.get_id() + i + bucket) % 5 + 1;
+
+        return static_cast<float>(weight) / sum;
+    }
+
+    void check_format(strategy::format_type format, double tolerance)
+    {
+        const std::string filename = std::string(::testing::UnitTest::GetInstance()->current_test_info()->name())
+            + ".str";
+
+        const kuhn_state root;
+        const auto states = game_state_base::get_state_vector(root);
+
+        strategy_writer writer(filename, strategy::create_header(format, "kuhn", "kuhn",
+            std::vector<int>(1, BUCKETS)));
+
+        for (const auto state : states)
+        {
+            writer.add_state();
+
+            for (int bucket = 0; bucket < BUCKETS; ++bucket)
+            {
+                std::vector<float> p(state->get_child_count());
+
+                for (int i = 0; i < state->get_child_count(); ++i)
+                    p[i] = get_expected(*state, i, bucket);
+
+                writer.add_probabilities(p.data(), p.data() + p.size());
+            }
+        }
+
+        writer.close();
+
+        const strategy s(filename);
+
+        ASSERT_EQ(format, s.get_format());
+        ASSERT_EQ(static_cast<int>(states.size()), s.get_state_count());
+        EXPECT_EQ("kuhn", s.get_game());
+        EXPECT_EQ(BUCKETS, s.get_header()->bucket_counts[0]);
+
+        for (const auto state : states)
+        {
+            for (int bucket = 0; bucket < BUCKETS; ++bucket)
+            {
+                double sum = 0;
+
+                for (int i = 0; i < state->get_child_count(); ++i)
+                {
+                    EXPECT_NEAR(get_expected(*state, i, bucket), s.get_probability(*state, i, bucket), tolerance);
+                    sum += s.get_probability(*state, i, bucket);
+                }
+
+                EXPECT_NEAR(1.0, sum, 1e-5);
+
+                const auto child = s.get_random_child(*state, bucket);
+
+                EXPECT_TRUE(child >= 0 && child < state->get_child_count());
+            }
+        }
+    }
+}
+
+TEST(strategy, float_format)
+{
+    check_format(strategy::FLOAT_FORMAT, 0);
+}
+
+TEST(strategy, uint16_format)
+{
+    check_format(strategy::UINT16_FORMAT, 1.0 / 0xffff);
+}
+
+TEST(strategy, uint8_format)
+{
+    check_format(strategy::UINT8_FORMAT, 1.0 / 0xff);
+}
+
+TEST(strategy, legacy_format)
+{
+    const std::string filename = "legacy_format.str";
+    const kuhn_state root;
+    const auto states = game_state_base::get_state_vector(root);
+
+    {
+        auto file = binary_open(filename, "wb");
+        std::vector<std::uint64_t> positions;
+
+        for (const auto state : states)
+        {
+            positions.push_back(positions.size() * BUCKETS * state->get_child_count() * sizeof(float));
+            const std::vector<float> p(BUCKETS * state->get_child_count(), 1.0f / state->get_child_count());
+            binary_write(*file, p.data(), p.size());
+        }
+
+        binary_write(*file, positions.data(), positions.size());
+    }
+
+    EXPECT_FALSE(strategy::has_header(filename));
+    EXPECT_THROW(strategy s(filename), std::runtime_error);
+
+    const strategy s(filename, static_cast<int>(states.size()));
+
+    EXPECT_EQ(strategy::FLOAT_FORMAT, s.get_format());
+    EXPECT_EQ(nullptr, s.get_header());
+    EXPECT_FLOAT_EQ(0.5f, s.get_probability(root, 1, BUCKETS - 1));
+}
+
+TEST(strategy, state_count_mismatch)
+{
+    const std::string filename = "state_count_mismatch.str";
+    strategy_writer writer(filename, strategy::create_header(strategy::FLOAT_FORMAT, "kuhn", "kuhn",
+        std::vector<int>(1, BUCKETS)));
+    writer.add_state();
+    writer.close();
+
+    EXPECT_NO_THROW(strategy s(filename));
+    EXPECT_THROW(strategy s(filename, 2), std::runtime_error);
+}
+
+TEST(strategy, quantize_sums_to_scale)
+{
+    const std::array<float, 3> p = {{1 / 3.0f, 1 / 3.0f, 1 / 3.0f}};
+    std::array<std::uint32_t, 3> q;
+
+    strategy_writer::quantize(p.data(), p.data() + p.size(), 0xff, q.data());
+
+    EXPECT_EQ(0xffu, q[0] + q[1] + q[2]);
+    EXPECT_EQ(85u, q[0]);
+    EXPECT_EQ(85u, q[1]);
+    EXPECT_EQ(85u, q[2]);
+}
+
+TEST(strategy, random_child_distribution)
+{
+    const std::string filename = "random_child_distribution.str";
+    const kuhn_state root;
+    const auto states = game_state_base::get_state_vector(root);
+    const std::array<float, 2 * BUCKETS> p = {{0.0f, 1.0f, 0.25f, 0.75f, 0.9f, 0.1f}};
+
+    strategy_writer writer(filename, strategy::create_header(strategy::FLOAT_FORMAT, "kuhn", "kuhn",
+        std::vector<int>(1, BUCKETS)));
+
+    for (std::size_t i = 0; i < states.size(); ++i)
+    {
+        writer.add_state();
+        writer.add_probabilities(p.data(), p.data() + p.size());
+    }
+
+    writer.close();
+
+    const strategy s(filename);
+    std::mt19937 engine(1);
+    const int samples = 100000;
+
+    for (int bucket = 0; bucket < BUCKETS; ++bucket)
+    {
+        int count = 0;
+
+        for (int i = 0; i < samples; ++i)
+            count += s.get_random_child(root, bucket, engine);
+
+        EXPECT_NEAR(p[bucket * 2 + 1], double(count) / samples, 0.01);
+    }
+
+    for (int i = 0; i < samples; ++i)
+        ASSERT_EQ(1, s.get_random_child(root, 0, engine));
+}
+
+TEST(strategy, random_child_after_write)
+{
+    const std::string filename = "random_child_after_write.str";
+    const kuhn_state root;
+    const auto states = game_state_base::get_state_vector(root);
+    const std::array<float, 2 * BUCKETS> p = {{0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f}};
+
+    strategy_writer writer(filename, strategy::create_header(strategy::FLOAT_FORMAT, "kuhn", "kuhn",
+        std::vector<int>(1, BUCKETS)));
+
+    for (std::size_t i = 0; i < states.size(); ++i)
+    {
+        writer.add_state();
+        writer.add_probabilities(p.data(), p.data() + p.size());
+    }
+
+    writer.close();
+
+    strategy s(filename, false);
+    std::mt19937 engine(1);
+
+    ASSERT_EQ(1, s.get_random_child(root, 0, engine));
+
+    // rows rewritten in place are sampled with their new probabilities
+    auto data = s.get_data(root, 0, 0);
+    data[0] = 1;
+    data[1] = 0;
+
+    for (int i = 0; i < 1000; ++i)
+        ASSERT_EQ(0, s.get_random_child(root, 0, engine));
+}
+
+TEST(strategy, random_child_concurrent)
+{
+    const std::string filename = "random_child_concurrent.str";
+    const kuhn_state root;
+    const auto states = game_state_base::get_state_vector(root);
+    const std::array<float, 2 * BUCKETS> p = {{0.0f, 1.0f, 0.25f, 0.75f, 0.9f, 0.1f}};
+
+    strategy_writer writer(filename, strategy::create_header(strategy::UINT16_FORMAT, "kuhn", "kuhn",
+        std::vector<int>(1, BUCKETS)));
+
+    for (std::size_t i = 0; i < states.size(); ++i)
+    {
+        writer.add_state();
+        writer.add_probabilities(p.data(), p.data() + p.size());
+    }
+
+    writer.close();
+
+    // every thread builds or reads the shared tables of all states without locking
+    const strategy s(filename);
+    const int samples = 100000;
+    std::array<int, BUCKETS> counts = {{}};
+
+#pragma omp parallel
+    {
+        std::mt19937 engine(omp_get_thread_num());
+        std::array<int, BUCKETS> thread_counts = {{}};
+
+#pragma omp for
+        for (int i = 0; i < samples; ++i)
+        {
+            for (int bucket = 0; bucket < BUCKETS; ++bucket)
+                thread_counts[bucket] += s.get_random_child(*states[i % states.size()], bucket, engine);
+        }
+
+#pragma omp critical
+        for (int bucket = 0; bucket < BUCKETS; ++bucket)
+            counts[bucket] += thread_counts[bucket];
+    }
+
+    for (int bucket = 0; bucket < BUCKETS; ++bucket)
+        EXPECT_NEAR(p[bucket * 2 + 1], double(counts[bucket]) / samples, 0.01);
+}
+
+TEST(strategy, batch_matches_single_lookups)
+{
+    const kuhn_state root;
+    const auto states = game_state_base::get_state_vector(root);
+
+    for (const auto format : {strategy::FLOAT_FORMAT, strategy::UINT16_FORMAT})
+    {
+        const std::string filename = "batch_matches_single_lookups.str";
+
+        // every row has all of its probability on one child so that the sampled children are known
+        strategy_writer writer(filename, strategy::create_header(format, "kuhn", "kuhn",
+            std::vector<int>(1, BUCKETS)));
+
+        for (const auto state : states)
+        {
+            writer.add_state();
+
+            for (int bucket = 0; bucket < BUCKETS; ++bucket)
+            {
+                std::vector<float> p(state->get_child_count());
+                p[(state->get_id() + bucket) % p.size()] = 1;
+                writer.add_probabilities(p.data(), p.data() + p.size());
+            }
+        }
+
+        writer.close();
+
+        const strategy s(filename);
+        std::vector<const game_state_base*> batch_states;
+        std::vector<int> buckets;
+
+        for (const auto state : states)
+        {
+            for (int bucket = 0; bucket < BUCKETS; ++bucket)
+            {
+                batch_states.push_back(state);
+                buckets.push_back(bucket);
+            }
+        }
+
+        // one column wider than any state to check the padding
+        const int width = 3;
+        std::vector<strategy::probability_t> probabilities(batch_states.size() * width, -1);
+        s.get_probabilities_batch(batch_states.data(), buckets.data(), batch_states.size(), width,
+            probabilities.data());
+
+        std::vector<int> children(batch_states.size());
+        s.get_random_children(batch_states.data(), buckets.data(), batch_states.size(), children.data());
+
+        for (std::size_t i = 0; i < batch_states.size(); ++i)
+        {
+            const auto& state = *batch_states[i];
+            std::vector<strategy::probability_t> expected(width);
+            s.get_probabilities(state, buckets[i], expected.data());
+
+            for (int j = 0; j < width; ++j)
+                EXPECT_EQ(expected[j], probabilities[i * width + j]);
+
+            EXPECT_EQ(s.get_random_child(state, buckets[i]), children[i]);
+        }
+
+        EXPECT_THROW(s.get_probabilities_batch(batch_states.data(), buckets.data(), batch_states.size(), 1,
+            probabilities.data()), std::runtime_error);
+    }
+}